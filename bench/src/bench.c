@@ -0,0 +1,296 @@
+/**
+ * @file bench.c
+ * @author  Julien "Juju" Savard <juju2143@gmail.com>
+ * @version 0.1
+ *
+ * @section LICENSE
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301  USA
+ *
+ * @section DESCRIPTION
+ *
+ * Microbenchmarks of the console and screen hot paths.
+ *
+ * Built with "make bench" in the library directory, it runs on the computer
+ * against the host build and prints ns/op, pixels written to the VRAM per op
+ * (from nio_stats_get(), the host build counts them), pixels pushed to the
+ * screen per op and presents per op. Built with the Makefile of this directory, it is an
+ * add-in that shows the time of each benchmark in RTC ticks (1/128 s).
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <fxcg/display.h>
+#include <fxcg/rtc.h>
+#include <prizmio.h>
+
+#ifdef PRIZMIO_HOST
+#include <stdio.h>
+#include <time.h>
+#include <prizmio_host.h>
+
+// Time in ns
+typedef unsigned long long bench_time;
+#define BENCH_MIN_TIME 200000000ULL
+
+static bench_time bench_now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (bench_time)ts.tv_sec*1000000000ULL + ts.tv_nsec;
+}
+#else
+#include <fxcg/keyboard.h>
+
+// Time in RTC ticks
+typedef unsigned int bench_time;
+#define BENCH_MIN_TIME 64
+
+static bench_time bench_now(void)
+{
+	return RTC_GetTicks();
+}
+#endif
+
+#define BENCH_MAX_OPS (1L<<24)
+
+typedef struct
+{
+	const char* name;
+	void (*setup)(void);
+	void (*run)(long ops);
+} bench;
+
+typedef struct
+{
+	long ops;
+	bench_time time;
+	long presents;
+	long rows;
+	unsigned long pixels;
+} bench_result;
+
+static nio_console csl;
+static volatile unsigned sink;
+
+// Lines like those of a program logging its progress
+static const char* log_lines[] = {
+	"[    0.000] boot: prizmio console ready\n",
+	"[    0.013] reg: opened \\\\fls0\\prizmio.reg, 42 keys\n",
+	"[    0.021] uart: 115200 baud, loopback off\n",
+	"[    0.034] net: waiting for peer...\n",
+	"[    0.250] xfer: sent frame 17 (256 bytes), window 8\n",
+	"[    0.251] xfer: ack 17\n",
+	"[    0.480] warn: retrying frame 18 after timeout\n",
+	"[    0.512] kbd: key 79 down, repeat in 500 ms\n"
+};
+#define LOG_LINES (sizeof(log_lines)/sizeof(log_lines[0]))
+
+static const char* words[] = {
+	"error", "warning", "note:", "the", "quick", "brown", "fox", "jumps",
+	"over", "lazy", "dog", "0x1f2e", "ok", "done", "[42]", "..."
+};
+#define WORDS (sizeof(words)/sizeof(words[0]))
+
+static void setup_empty(void)
+{
+	nio_clear(&csl);
+}
+
+static void setup_full(void)
+{
+	int i;
+	nio_clear(&csl);
+	for(i = 0; i < csl.max_y; i++)
+		nio_fputs(log_lines[i%LOG_LINES], &csl);
+}
+
+static void run_fputc(long ops)
+{
+	const char* p = log_lines[0];
+	unsigned line = 0;
+	long i;
+	for(i = 0; i < ops; i++)
+	{
+		if(*p == '\0')
+			p = log_lines[++line%LOG_LINES];
+		nio_fputc(*p++, &csl);
+	}
+}
+
+static void run_fputs(long ops)
+{
+	long i;
+	for(i = 0; i < ops; i++)
+		nio_fputs(log_lines[i%LOG_LINES], &csl);
+}
+
+static void run_fprintf(long ops)
+{
+	long i;
+	for(i = 0; i < ops; i++)
+		nio_fprintf(&csl, "[%5ld] %-8s %08lx %s\n", i, words[i%WORDS], (unsigned long)i*2654435761UL, words[(i/WORDS)%WORDS]);
+}
+
+static void run_colored(long ops)
+{
+	long i;
+	for(i = 0; i < ops; i++)
+	{
+		nio_color(&csl, NIO_COLOR_BLACK, 1+i%15);
+		nio_fprintf(&csl, "%s%c", words[i%WORDS], i%8 == 7 ? '\n' : ' ');
+	}
+}
+
+static void run_scroll(long ops)
+{
+	long i;
+	for(i = 0; i < ops; i++)
+		nio_scroll(&csl);
+}
+
+// A scroll storm as seen on the screen
+static void run_scroll_flush(long ops)
+{
+	long i;
+	for(i = 0; i < ops; i++)
+	{
+		nio_scroll(&csl);
+		nio_fflush(&csl);
+	}
+}
+
+static void run_fflush(long ops)
+{
+	long i;
+	for(i = 0; i < ops; i++)
+	{
+		nio_invalidate(&csl);
+		nio_fflush(&csl);
+	}
+}
+
+static void run_clear(long ops)
+{
+	long i;
+	for(i = 0; i < ops; i++)
+		nio_clear(&csl);
+}
+
+static void run_pixel_putc(long ops)
+{
+	long i;
+	for(i = 0; i < ops; i++)
+	{
+		int cell = i%(NIO_MAX_COLS*NIO_MAX_ROWS);
+		nio_vram_pixel_putc((cell%NIO_MAX_COLS)*NIO_CHAR_WIDTH, (cell/NIO_MAX_COLS)*NIO_CHAR_HEIGHT, 33+i%94, NIO_COLOR_BLACK, 1+i%15);
+	}
+}
+
+static void run_palette(long ops)
+{
+	unsigned sum = 0;
+	long i;
+	for(i = 0; i < ops; i++)
+		sum += getPaletteColor(i&0xFF);
+	sink = sum;
+}
+
+static const bench benches[] = {
+	{"fputc",       setup_empty, run_fputc},
+	{"fputs",       setup_empty, run_fputs},
+	{"fprintf",     setup_empty, run_fprintf},
+	{"colored",     setup_empty, run_colored},
+	{"scroll",      setup_full,  run_scroll},
+	{"scroll+flush",setup_full,  run_scroll_flush},
+	{"fflush",      setup_full,  run_fflush},
+	{"clear",       setup_full,  run_clear},
+	{"pixel_putc",  setup_empty, run_pixel_putc},
+	{"palette",     setup_empty, run_palette}
+};
+#define BENCHES (sizeof(benches)/sizeof(benches[0]))
+
+// Doubles the number of ops until a run takes at least BENCH_MIN_TIME
+static void bench_run(const bench* b, bench_result* r)
+{
+	long ops = 1;
+	while(1)
+	{
+		bench_time start;
+		nio_stats stats;
+		b->setup();
+#ifdef PRIZMIO_HOST
+		host_present_reset();
+#endif
+		nio_stats_reset(NULL);
+		start = bench_now();
+		b->run(ops);
+		r->time = bench_now()-start;
+		r->ops = ops;
+#ifdef PRIZMIO_HOST
+		r->presents = host_presents;
+		r->rows = host_present_rows;
+#endif
+		nio_stats_get(NULL, &stats);
+		r->pixels = stats.pixels;
+		if(r->time >= BENCH_MIN_TIME || ops >= BENCH_MAX_OPS)
+			break;
+		ops *= 2;
+	}
+}
+
+int main()
+{
+	bench_result results[BENCHES];
+	unsigned i;
+
+	Bdisp_AllClr_VRAM();
+#ifndef PRIZMIO_HOST
+	Bdisp_EnableColor(1);
+#endif
+	nio_init(&csl, NIO_MAX_COLS, NIO_MAX_ROWS, 0, 0, NIO_COLOR_BLACK, NIO_COLOR_WHITE, TRUE);
+
+	for(i = 0; i < BENCHES; i++)
+		bench_run(&benches[i], &results[i]);
+
+#ifdef PRIZMIO_HOST
+	nio_free(&csl);
+	printf("%-13s %10s %12s %12s %12s %12s\n", "bench", "ops", "ns/op", "px/op", "lcd px/op", "presents/op");
+	for(i = 0; i < BENCHES; i++)
+	{
+		const bench_result* r = &results[i];
+		printf("%-13s %10ld %12.1f %12.1f %12.1f %12.4f\n", benches[i].name, r->ops,
+			(double)r->time/r->ops,
+			(double)r->pixels/r->ops,
+			(double)r->rows*LCD_WIDTH_PX/r->ops,
+			(double)r->presents/r->ops);
+	}
+#else
+	nio_clear(&csl);
+	nio_color(&csl, NIO_COLOR_BLACK, NIO_COLOR_WHITE);
+	nio_fprintf(&csl, "%-13s %7s %8s %10s\n", "bench", "ops", "ticks", "us/op");
+	for(i = 0; i < BENCHES; i++)
+	{
+		const bench_result* r = &results[i];
+		nio_fprintf(&csl, "%-13s %7ld %8u %10lu\n", benches[i].name, r->ops, r->time,
+			(unsigned long)((unsigned long long)r->time*1000000/128/r->ops));
+	}
+	nio_fprintf(&csl, "\nPress any key to exit\n");
+	int key;
+	GetKey(&key);
+	nio_free(&csl);
+#endif
+	return 0;
+}
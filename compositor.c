@@ -0,0 +1,258 @@
+/**
+ * @file compositor.c
+ * @author  Julien "Juju" Savard <juju2143@gmail.com>
+ * @version 0.1
+ *
+ * @section LICENSE
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301  USA
+ *
+ * @section DESCRIPTION
+ *
+ * Compositor
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <fxcg/display.h>
+#include "prizmio.h"
+
+/* The consoles of a compositor do not draw themselves, they only mark
+ * their dirty cells. A frame draws the dirty cells from the bottom
+ * console to the top one and presents once. A cell fully under a higher
+ * visible console is not drawn. A cell partly under one is drawn, and
+ * the cells of the higher console over it are drawn again after it.
+ */
+
+struct comp_rect
+{
+	int x1, y1, x2, y2; // x2 and y2 are excluded
+};
+
+static void nio_compositor_rect(const nio_console* c, struct comp_rect* r)
+{
+	r->x1 = c->offset_x;
+	r->y1 = c->offset_y;
+	r->x2 = c->offset_x+c->max_x*NIO_CHAR_WIDTH;
+	r->y2 = c->offset_y+c->max_y*NIO_CHAR_HEIGHT;
+}
+
+static inline BOOL nio_compositor_overlap(const struct comp_rect* a, const struct comp_rect* b)
+{
+	return a->x1 < b->x2 && b->x1 < a->x2 && a->y1 < b->y2 && b->y1 < a->y2;
+}
+
+static int nio_compositor_find(const nio_compositor* comp, const nio_console* c)
+{
+	int i;
+	for(i = 0; i < comp->count; i++)
+	{
+		if(comp->consoles[i] == c)
+			return i;
+	}
+	return -1;
+}
+
+// Redraws the visible consoles under a rectangle, and clears it first if asked to.
+static void nio_compositor_damage(nio_compositor* comp, const struct comp_rect* r, const BOOL clear)
+{
+	int i;
+	if(clear)
+		nio_vram_fill(r->x1, r->y1, r->x2-r->x1, r->y2-r->y1, comp->background);
+	for(i = 0; i < comp->count; i++)
+	{
+		if(comp->visible[i])
+			nio_invalidate_rect(comp->consoles[i], r->x1, r->y1, r->x2-r->x1, r->y2-r->y1);
+	}
+}
+
+void nio_compositor_init(nio_compositor* comp, const unsigned char background_color)
+{
+	comp->count = 0;
+	comp->background = getPaletteColor(background_color);
+}
+
+int nio_compositor_add(nio_compositor* comp, nio_console* c)
+{
+	if(comp->count == NIO_COMPOSITOR_MAX || c->compositor != NULL)
+		return -1;
+	// The cursor is drawn straight to the screen, take it off first
+	nio_cursor_erase(c);
+	comp->consoles[comp->count] = c;
+	comp->visible[comp->count] = TRUE;
+	comp->drawing[comp->count] = c->drawing_enabled;
+	comp->count++;
+	c->compositor = comp;
+	c->drawing_enabled = FALSE;
+	nio_invalidate(c);
+	return 0;
+}
+
+void nio_compositor_remove(nio_compositor* comp, nio_console* c)
+{
+	struct comp_rect r;
+	int i = nio_compositor_find(comp, c);
+	BOOL visible;
+	if(i < 0)
+		return;
+	visible = comp->visible[i];
+	c->drawing_enabled = comp->drawing[i];
+	c->compositor = NULL;
+	comp->count--;
+	memmove(comp->consoles+i, comp->consoles+i+1, (comp->count-i)*sizeof(nio_console*));
+	memmove(comp->visible+i, comp->visible+i+1, (comp->count-i)*sizeof(BOOL));
+	memmove(comp->drawing+i, comp->drawing+i+1, (comp->count-i)*sizeof(BOOL));
+	if(visible)
+	{
+		nio_compositor_rect(c, &r);
+		nio_compositor_damage(comp, &r, TRUE);
+	}
+}
+
+void nio_compositor_show(nio_compositor* comp, nio_console* c, const BOOL visible)
+{
+	struct comp_rect r;
+	int i = nio_compositor_find(comp, c);
+	if(i < 0 || comp->visible[i] == visible)
+		return;
+	comp->visible[i] = visible;
+	nio_compositor_rect(c, &r);
+	// Shown, it draws over what is there. Hidden, what was under it comes back.
+	nio_compositor_damage(comp, &r, !visible);
+}
+
+// Moves a console to a place in the z-order, and redraws where it is.
+static void nio_compositor_move(nio_compositor* comp, nio_console* c, const int to)
+{
+	struct comp_rect r;
+	int i = nio_compositor_find(comp, c);
+	BOOL visible, drawing;
+	if(i < 0 || i == to)
+		return;
+	visible = comp->visible[i];
+	drawing = comp->drawing[i];
+	if(i < to)
+	{
+		memmove(comp->consoles+i, comp->consoles+i+1, (to-i)*sizeof(nio_console*));
+		memmove(comp->visible+i, comp->visible+i+1, (to-i)*sizeof(BOOL));
+		memmove(comp->drawing+i, comp->drawing+i+1, (to-i)*sizeof(BOOL));
+	}
+	else
+	{
+		memmove(comp->consoles+to+1, comp->consoles+to, (i-to)*sizeof(nio_console*));
+		memmove(comp->visible+to+1, comp->visible+to, (i-to)*sizeof(BOOL));
+		memmove(comp->drawing+to+1, comp->drawing+to, (i-to)*sizeof(BOOL));
+	}
+	comp->consoles[to] = c;
+	comp->visible[to] = visible;
+	comp->drawing[to] = drawing;
+	if(visible)
+	{
+		nio_compositor_rect(c, &r);
+		nio_compositor_damage(comp, &r, FALSE);
+	}
+}
+
+void nio_compositor_raise(nio_compositor* comp, nio_console* c)
+{
+	nio_compositor_move(comp, c, comp->count-1);
+}
+
+void nio_compositor_lower(nio_compositor* comp, nio_console* c)
+{
+	nio_compositor_move(comp, c, 0);
+}
+
+// Draws the dirty cells of the console at index i, returns how many.
+static int nio_compositor_draw(nio_compositor* comp, const int i)
+{
+	nio_console* c = comp->consoles[i];
+	struct comp_rect r, above[NIO_COMPOSITOR_MAX];
+	int count = 0, drawn = 0;
+	int stride = NIO_DIRTY_STRIDE(c);
+	int row, col, j, k;
+
+	// Only the visible consoles higher up that overlap this one matter
+	nio_compositor_rect(c, &r);
+	for(j = i+1; j < comp->count; j++)
+	{
+		if(!comp->visible[j])
+			continue;
+		nio_compositor_rect(comp->consoles[j], &above[count]);
+		if(nio_compositor_overlap(&r, &above[count]))
+			count++;
+	}
+
+	for(row = 0; row < c->max_y; row++)
+	{
+		unsigned char* bits = c->dirty+row*stride;
+		// Columns of this row fully under each console above, from hidden[k][0] to hidden[k][1] excluded
+		int hidden[NIO_COMPOSITOR_MAX][2];
+		int y1 = c->offset_y+row*NIO_CHAR_HEIGHT;
+		int y2 = y1+NIO_CHAR_HEIGHT;
+		for(k = 0; k < count; k++)
+		{
+			hidden[k][0] = hidden[k][1] = 0;
+			if(above[k].y1 <= y1 && above[k].y2 >= y2)
+			{
+				hidden[k][0] = (above[k].x1-c->offset_x+NIO_CHAR_WIDTH-1)/NIO_CHAR_WIDTH;
+				hidden[k][1] = (above[k].x2-c->offset_x)/NIO_CHAR_WIDTH;
+				if(above[k].x1 < c->offset_x)
+					hidden[k][0] = 0;
+			}
+		}
+		for(j = 0; j < stride; j++)
+		{
+			if(bits[j] == 0)
+				continue;
+			for(col = j*8; col < j*8+8 && col < c->max_x; col++)
+			{
+				if(!(bits[j] & (1 << (col&7))))
+					continue;
+				for(k = 0; k < count; k++)
+				{
+					if(col >= hidden[k][0] && col < hidden[k][1])
+						break;
+				}
+				if(k < count)
+					continue;
+				nio_vram_csl_drawchar(c,col,row);
+				drawn++;
+				// Draw again what this cell went over
+				for(k = i+1; count > 0 && k < comp->count; k++)
+				{
+					if(comp->visible[k])
+						nio_invalidate_rect(comp->consoles[k], c->offset_x+col*NIO_CHAR_WIDTH, y1, NIO_CHAR_WIDTH, NIO_CHAR_HEIGHT);
+				}
+			}
+			// Hidden cells are done too, they are drawn again when they show
+			bits[j] = 0;
+		}
+	}
+	return drawn;
+}
+
+int nio_compositor_frame(nio_compositor* comp)
+{
+	int i, drawn = 0;
+	nio_present_hold();
+	for(i = 0; i < comp->count; i++)
+	{
+		if(comp->visible[i])
+			drawn += nio_compositor_draw(comp, i);
+	}
+	nio_present_release();
+	return drawn;
+}
@@ -28,17 +28,33 @@
 #include "prizmio.h"
 #include <stdlib.h>
 #include <stdio.h>
+#include <stdarg.h>
 #include <string.h>
 #include <fxcg/keyboard.h>
+#include <fxcg/display.h>
+#include "keymap.h"
 
 nio_console* nio_default = NULL;
 
+static inline int nio_csl_index(const nio_console* c, const int pos_x, const int pos_y)
+{
+	int row = c->head+pos_y;
+	if(row >= c->max_y)
+		row -= c->max_y;
+	return row*c->max_x+pos_x;
+}
+
+#ifdef PRIZMIO_HOST
+const unsigned short* keyboard_register = host_keyboard;
+#else
 const unsigned short* keyboard_register = (unsigned short*)0xA44B0000;
+#endif
 unsigned short lastkey[8];
 unsigned short holdkey[8];
 
 void keyupdate(void)
 {
+	NIO_STAT(kbd_polls, 1);
 	memcpy(holdkey, lastkey, sizeof(unsigned short)*8);
 	memcpy(lastkey, keyboard_register, sizeof(unsigned short)*8);
 }
@@ -95,76 +111,424 @@ void nio_free_stdio(void)
     nio_free(nio_default);
 }
 
-void nio_load(const char* path, nio_console* c)
+// The colors, chars and dirty bitmap of a console share one allocation.
+static BOOL nio_csl_alloc(nio_console* c)
 {
-	FILE* f = fopen(path,"rb");
+	int cells = c->max_x*c->max_y;
+	c->color = malloc(cells*(sizeof(unsigned short)+sizeof(char))+NIO_DIRTY_STRIDE(c)*c->max_y);
+	if(c->color == NULL)
+		return FALSE;
+	c->data = (char*)(c->color+cells);
+	c->dirty = (unsigned char*)(c->data+cells);
+	return TRUE;
+}
+
+#define NIO_SNAPSHOT_MAGIC 0x4E494F53 // "NIOS"
+#define NIO_SNAPSHOT_VERSION 1
+#define NIO_SNAPSHOT_RLE 0x0001
+
+/* Snapshot files are this header followed by the payload: the colors of
+ * all cells, then their chars, top row first. Values are stored in the
+ * byte order of the machine. With NIO_SNAPSHOT_RLE both arrays are
+ * run-length encoded, see nio_rle_encode(). The checksum is the CRC-32
+ * of the payload as stored.
+ */
+struct nio_snapshot_header
+{
+	unsigned int magic;
+	unsigned short version;
+	unsigned short flags;
+	unsigned int payload_size;
+	unsigned int checksum;
+	short cursor_x;
+	short cursor_y;
+	short max_x;
+	short max_y;
+	short offset_x;
+	short offset_y;
+	unsigned char default_background_color;
+	unsigned char default_foreground_color;
+	unsigned char drawing_enabled;
+	unsigned char cursor_enabled;
+	unsigned char cursor_type;
+	unsigned char cursor_line_width;
+	unsigned char cursor_custom_data[6];
+	unsigned char cursor_blink_enabled;
+	unsigned char cursor_blink_status;
+	unsigned short reserved;
+	unsigned int cursor_blink_duration;
+};
+
+/* PackBits-like RLE on units of 1 or 2 bytes: a control byte n < 128 is
+ * followed by n+1 literal units, n >= 128 by one unit repeated n-125 times.
+ * dst needs room for count*unit+(count+127)/128 bytes.
+ */
+static size_t nio_rle_encode(const unsigned char* src, int count, int unit, unsigned char* dst)
+{
+	unsigned char* out = dst;
+	int i = 0;
+	while(i < count)
+	{
+		int run = 1;
+		while(i+run < count && run < 130 && !memcmp(src+i*unit, src+(i+run)*unit, unit))
+			run++;
+		if(run >= 3)
+		{
+			*out++ = run+125;
+			memcpy(out, src+i*unit, unit);
+			out += unit;
+			i += run;
+		}
+		else
+		{
+			// Collect literals until the next run of 3 or more
+			int start = i;
+			while(i < count && i-start < 128)
+			{
+				if(i+2 < count && !memcmp(src+i*unit, src+(i+1)*unit, unit) && !memcmp(src+i*unit, src+(i+2)*unit, unit))
+					break;
+				i++;
+			}
+			*out++ = i-start-1;
+			memcpy(out, src+start*unit, (i-start)*unit);
+			out += (i-start)*unit;
+		}
+	}
+	return out-dst;
+}
+
+struct nio_snapshot_reader
+{
+	FILE* f;
+	size_t left;
+	unsigned int crc;
+	int pos;
+	int len;
+	unsigned char buf[128];
+};
+
+static int nio_snapshot_getc(struct nio_snapshot_reader* r)
+{
+	if(r->pos == r->len)
+	{
+		int n = r->left < sizeof(r->buf) ? r->left : sizeof(r->buf);
+		if(n == 0 || (int)fread(r->buf, 1, n, r->f) != n)
+			return -1;
+		r->crc = nio_crc32(r->crc, r->buf, n);
+		r->left -= n;
+		r->pos = 0;
+		r->len = n;
+	}
+	return r->buf[r->pos++];
+}
+
+// Decodes count units from the file straight into dst.
+static BOOL nio_rle_decode(struct nio_snapshot_reader* r, unsigned char* dst, int count, int unit)
+{
+	while(count > 0)
+	{
+		int n = nio_snapshot_getc(r);
+		int i, b;
+		if(n < 0)
+			return FALSE;
+		if(n < 128)
+		{
+			n = (n+1)*unit;
+			if(n > count*unit)
+				return FALSE;
+			count -= n/unit;
+			for(i = 0; i < n; i++)
+			{
+				if((b = nio_snapshot_getc(r)) < 0)
+					return FALSE;
+				*dst++ = b;
+			}
+		}
+		else
+		{
+			n -= 125;
+			if(n > count)
+				return FALSE;
+			count -= n;
+			for(i = 0; i < unit; i++)
+			{
+				if((b = nio_snapshot_getc(r)) < 0)
+					return FALSE;
+				dst[i] = b;
+			}
+			for(i = 1; i < n; i++)
+				memcpy(dst+i*unit, dst, unit);
+			dst += n*unit;
+		}
+	}
+	return TRUE;
+}
+
+static BOOL nio_snapshot_check(const struct nio_snapshot_header* h)
+{
+	size_t raw;
+	if(h->magic != NIO_SNAPSHOT_MAGIC || h->version != NIO_SNAPSHOT_VERSION
+		|| h->max_x <= 0 || h->max_x > 255 || h->max_y <= 0 || h->max_y > 255
+		|| h->cursor_x < 0 || h->cursor_x > h->max_x || h->cursor_y < 0 || h->cursor_y >= h->max_y)
+		return FALSE;
+	raw = h->max_x*h->max_y*(sizeof(unsigned short)+sizeof(char));
+	return (h->flags & NIO_SNAPSHOT_RLE) || h->payload_size == raw;
+}
+
+// Sets up a console from a checked header, once its cells are loaded.
+static void nio_snapshot_apply(const struct nio_snapshot_header* h, nio_console* t)
+{
+	t->cursor_x = h->cursor_x;
+	t->cursor_y = h->cursor_y;
+	t->offset_x = h->offset_x;
+	t->offset_y = h->offset_y;
+	t->default_background_color = h->default_background_color;
+	t->default_foreground_color = h->default_foreground_color;
+	t->drawing_enabled = h->drawing_enabled ? TRUE : FALSE;
+	t->cursor_enabled = h->cursor_enabled ? TRUE : FALSE;
+	t->cursor_type = h->cursor_type;
+	t->cursor_line_width = h->cursor_line_width;
+	memcpy(t->cursor_custom_data,h->cursor_custom_data,6);
+	t->cursor_blink_enabled = h->cursor_blink_enabled ? TRUE : FALSE;
+	t->cursor_blink_status = h->cursor_blink_status ? TRUE : FALSE;
+	t->cursor_blink_duration = h->cursor_blink_duration;
+	t->palette = nio_default_palette;
+	t->scrollback = NULL;
+	t->head = 0;
+	t->cursor_blink_timestamp = nio_time_get();
+	t->cursor_drawn = FALSE;
+}
+
+/* Fills the header and the plain payload of a snapshot of c.
+ * buf needs room for the header and the payload, the checksum is left to the caller.
+ */
+static void nio_snapshot_fill(const nio_console* c, unsigned char* buf)
+{
+	struct nio_snapshot_header* h = (struct nio_snapshot_header*)buf;
+	size_t cells = c->max_x*c->max_y;
+	unsigned short* colors = (unsigned short*)(buf+sizeof(*h));
+	char* data = (char*)(colors+cells);
+	int row;
 	
-	fread(&c->cursor_x,sizeof(int),1,f);
-	fread(&c->cursor_y,sizeof(int),1,f);
+	// Rows are written top to bottom, whatever the position of the ring
+	for(row = 0; row < c->max_y; row++)
+	{
+		memcpy(colors+row*c->max_x,c->color+nio_csl_index(c,0,row),c->max_x*sizeof(unsigned short));
+		memcpy(data+row*c->max_x,c->data+nio_csl_index(c,0,row),c->max_x);
+	}
 	
-	fread(&c->max_x,sizeof(int),1,f);
-	fread(&c->max_y,sizeof(int),1,f);
+	memset(h,0,sizeof(*h));
+	h->magic = NIO_SNAPSHOT_MAGIC;
+	h->version = NIO_SNAPSHOT_VERSION;
+	h->payload_size = cells*(sizeof(unsigned short)+sizeof(char));
+	h->cursor_x = c->cursor_x;
+	h->cursor_y = c->cursor_y;
+	h->max_x = c->max_x;
+	h->max_y = c->max_y;
+	h->offset_x = c->offset_x;
+	h->offset_y = c->offset_y;
+	h->default_background_color = c->default_background_color;
+	h->default_foreground_color = c->default_foreground_color;
+	h->drawing_enabled = c->drawing_enabled;
+	h->cursor_enabled = c->cursor_enabled;
+	h->cursor_type = c->cursor_type;
+	h->cursor_line_width = c->cursor_line_width;
+	memcpy(h->cursor_custom_data,c->cursor_custom_data,6);
+	h->cursor_blink_enabled = c->cursor_blink_enabled;
+	h->cursor_blink_status = c->cursor_blink_status;
+	h->cursor_blink_duration = c->cursor_blink_duration;
+}
+
+int nio_load(const char* path, nio_console* c)
+{
+	struct nio_snapshot_header h;
+	nio_console t;
+	size_t cells, raw;
+	unsigned int crc;
+	FILE* f = fopen(path,"rb");
+	if(f == NULL)
+		return -1;
 	
-	fread(&c->offset_x,sizeof(int),1,f);
-	fread(&c->offset_y,sizeof(int),1,f);
+	if(fread(&h,sizeof(h),1,f) != 1 || !nio_snapshot_check(&h))
+	{
+		fclose(f);
+		return -1;
+	}
+	cells = h.max_x*h.max_y;
+	raw = cells*(sizeof(unsigned short)+sizeof(char));
 	
-	fread(&c->default_background_color,sizeof(char),1,f);
-	fread(&c->default_foreground_color,sizeof(char),1,f);
+	// Build the console aside so c is left alone if the file is bad
+	memset(&t,0,sizeof(t));
+	t.max_x = h.max_x;
+	t.max_y = h.max_y;
+	if(!nio_csl_alloc(&t))
+	{
+		fclose(f);
+		return -1;
+	}
+	if(h.flags & NIO_SNAPSHOT_RLE)
+	{
+		struct nio_snapshot_reader r;
+		r.f = f;
+		r.left = h.payload_size;
+		r.crc = 0;
+		r.pos = r.len = 0;
+		if(!nio_rle_decode(&r,(unsigned char*)t.color,cells,sizeof(unsigned short))
+			|| !nio_rle_decode(&r,(unsigned char*)t.data,cells,sizeof(char))
+			|| r.left != 0 || r.pos != r.len)
+			crc = ~h.checksum;
+		else
+			crc = r.crc;
+	}
+	else if(fread(t.color,1,raw,f) != raw)
+		crc = ~h.checksum;
+	else
+		crc = nio_crc32(0,t.color,raw);
+	fclose(f);
+	if(crc != h.checksum)
+	{
+		free(t.color);
+		return -1;
+	}
 	
-	fread(&c->drawing_enabled,sizeof(BOOL),1,f);
-    
-    fread(&c->cursor_enabled,sizeof(BOOL),1,f);
-    fread(&c->cursor_type,sizeof(int),1,f);
-    fread(&c->cursor_line_width,sizeof(int),1,f);
-    fread(&c->cursor_custom_data,sizeof(char)*6,1,f);
-    fread(&c->cursor_blink_enabled,sizeof(BOOL),1,f);
-    fread(&c->cursor_blink_status,sizeof(BOOL),1,f);
-    fread(&c->cursor_blink_timestamp,sizeof(BOOL),1,f);
-    fread(&c->cursor_blink_duration,sizeof(BOOL),1,f);
+	nio_snapshot_apply(&h,&t);
+	*c = t;
+	nio_invalidate(c);
 	
-	c->data = malloc(c->max_x*c->max_y);
-	c->color = malloc(c->max_x*c->max_y);
+	if(c->drawing_enabled)
+		nio_fflush(c);
+	return 0;
+}
+
+int nio_save(const char* path, const nio_console* c)
+{
+	struct nio_snapshot_header* h;
+	size_t cells = c->max_x*c->max_y;
+	size_t raw = cells*(sizeof(unsigned short)+sizeof(char));
+	size_t rle;
+	int result;
+	FILE* f;
+	// Header, plain payload and room for the encoded one
+	unsigned char* buf = malloc(sizeof(*h)+raw+raw+2*((cells+127)/128));
+	if(buf == NULL)
+		return -1;
+	h = (struct nio_snapshot_header*)buf;
+	nio_snapshot_fill(c,buf);
 	
-	fread(c->data,sizeof(char),c->max_x*c->max_y,f);
-	fread(c->color,sizeof(short),c->max_x*c->max_y,f);
+	// Keep the encoded payload only if it is smaller
+	rle = nio_rle_encode(buf+sizeof(*h),cells,sizeof(unsigned short),buf+sizeof(*h)+raw);
+	rle += nio_rle_encode(buf+sizeof(*h)+cells*sizeof(unsigned short),cells,sizeof(char),buf+sizeof(*h)+raw+rle);
+	if(rle < raw)
+	{
+		memmove(buf+sizeof(*h),buf+sizeof(*h)+raw,rle);
+		h->flags |= NIO_SNAPSHOT_RLE;
+		h->payload_size = rle;
+	}
+	h->checksum = nio_crc32(0,buf+sizeof(*h),h->payload_size);
 	
-    if(c->drawing_enabled)
-        nio_fflush(c);
-    
+	f = fopen(path,"wb");
+	if(f == NULL)
+	{
+		free(buf);
+		return -1;
+	}
+	result = fwrite(buf,1,sizeof(*h)+h->payload_size,f) == sizeof(*h)+h->payload_size ? 0 : -1;
 	fclose(f);
+	free(buf);
+	return result;
 }
 
-void nio_save(const char* path, const nio_console* c)
+/* Consoles in a registry are snapshots with a plain payload, the
+ * registry compresses them. They are loaded through this sink, which
+ * takes the header, then writes the payload straight into the cells.
+ */
+struct nio_snapshot_sink
 {
-	FILE* f = fopen(path,"wb");
-	
-	fwrite(&c->cursor_x,sizeof(int),1,f);
-	fwrite(&c->cursor_y,sizeof(int),1,f);
-	
-	fwrite(&c->max_x,sizeof(int),1,f);
-	fwrite(&c->max_y,sizeof(int),1,f);
-	
-	fwrite(&c->offset_x,sizeof(int),1,f);
-	fwrite(&c->offset_y,sizeof(int),1,f);
-	
-	fwrite(&c->default_background_color,sizeof(char),1,f);
-	fwrite(&c->default_foreground_color,sizeof(char),1,f);
-	
-	fwrite(&c->drawing_enabled,sizeof(BOOL),1,f);
-    
-    fwrite(&c->cursor_enabled,sizeof(BOOL),1,f);
-    fwrite(&c->cursor_type,sizeof(int),1,f);
-    fwrite(&c->cursor_line_width,sizeof(int),1,f);
-    fwrite(&c->cursor_custom_data,sizeof(char)*6,1,f);
-    fwrite(&c->cursor_blink_enabled,sizeof(BOOL),1,f);
-    fwrite(&c->cursor_blink_status,sizeof(BOOL),1,f);
-    fwrite(&c->cursor_blink_timestamp,sizeof(BOOL),1,f);
-    fwrite(&c->cursor_blink_duration,sizeof(BOOL),1,f);
-	
-	fwrite(c->data,sizeof(char),c->max_x*c->max_y,f);
-	fwrite(c->color,sizeof(short),c->max_x*c->max_y,f);
+	struct nio_snapshot_header h;
+	nio_console t;
+	size_t pos;
+	size_t raw;
+	unsigned int crc;
+	BOOL bad;
+};
+
+static void nio_snapshot_write(void* ctx, const char* str, int len)
+{
+	struct nio_snapshot_sink* s = ctx;
+	if(s->bad)
+		return;
+	if(s->pos < sizeof(s->h))
+	{
+		int n = sizeof(s->h)-s->pos < (size_t)len ? (int)(sizeof(s->h)-s->pos) : len;
+		memcpy((char*)&s->h+s->pos,str,n);
+		s->pos += n;
+		str += n;
+		len -= n;
+		if(s->pos < sizeof(s->h))
+			return;
+		if(!nio_snapshot_check(&s->h) || (s->h.flags & NIO_SNAPSHOT_RLE))
+		{
+			s->bad = TRUE;
+			return;
+		}
+		s->t.max_x = s->h.max_x;
+		s->t.max_y = s->h.max_y;
+		s->raw = s->h.payload_size;
+		if(!nio_csl_alloc(&s->t))
+		{
+			s->bad = TRUE;
+			return;
+		}
+	}
+	// The colors and the chars follow each other in the allocation, like in the payload
+	if(s->pos-sizeof(s->h)+len > s->raw)
+	{
+		s->bad = TRUE;
+		return;
+	}
+	memcpy((char*)s->t.color+s->pos-sizeof(s->h),str,len);
+	s->crc = nio_crc32(s->crc,str,len);
+	s->pos += len;
+}
+
+int nio_reg_load(reg_db* db, const char* key, nio_console* c)
+{
+	struct nio_snapshot_sink s;
+	if(db == NULL && (db = reg_get_default()) == NULL)
+		return -1;
+	memset(&s,0,sizeof(s));
+	if(reg_db_stream(db,key,nio_snapshot_write,&s) != 0 || s.bad
+		|| s.pos != sizeof(s.h)+s.raw || s.crc != s.h.checksum)
+	{
+		free(s.t.color);
+		return -1;
+	}
+	nio_snapshot_apply(&s.h,&s.t);
+	*c = s.t;
+	nio_invalidate(c);
 	
-	fclose(f);
+	if(c->drawing_enabled)
+		nio_fflush(c);
+	return 0;
+}
+
+int nio_reg_save(reg_db* db, const char* key, const nio_console* c)
+{
+	struct nio_snapshot_header* h;
+	size_t raw = c->max_x*c->max_y*(sizeof(unsigned short)+sizeof(char));
+	int result;
+	unsigned char* buf;
+	if(db == NULL && (db = reg_get_default()) == NULL)
+		return -1;
+	buf = malloc(sizeof(*h)+raw);
+	if(buf == NULL)
+		return -1;
+	h = (struct nio_snapshot_header*)buf;
+	nio_snapshot_fill(c,buf);
+	h->checksum = nio_crc32(0,buf+sizeof(*h),raw);
+	result = reg_db_store(db,key,buf,sizeof(*h)+raw);
+	free(buf);
+	return result;
 }
 
 void nio_set_default(nio_console* c)
@@ -176,57 +540,53 @@ BOOL shift = FALSE;
 BOOL caps = FALSE;
 BOOL ctrl = FALSE;
 BOOL optn = FALSE;
-static char shiftKey(char normalc, char shiftc)
+static const nio_keymap* keymap = &nio_default_keymap;
+
+void nio_keymap_set(const nio_keymap* map)
 {
-	if(shift || caps) 
-	{
-		shift = FALSE;
-		return shiftc;
-	}
-	else return normalc;
+	keymap = map != NULL ? map : &nio_default_keymap;
 }
-static char shiftOrCtrlKey(char normalc, char shiftc, char ctrlc)
+
+const nio_keymap* nio_keymap_get(void)
 {
-	if(shift || caps)
-	{
-		shift = FALSE;
-		return shiftc;
-	}
-	else if(ctrl)
-	{
-		ctrl = FALSE;
-		return ctrlc;
-	}
-	else return normalc;
+	return keymap;
 }
-static char lowerOrUpperKey(char lowerc, char upperc)
+
+// Keys that went down between the last two keyupdate() calls, as in the matrix.
+static inline BOOL nio_key_new(const unsigned short* pressed, const int pos)
 {
-	if(optn) return upperc;
-	else return lowerc;
+	return (pressed[pos>>4] >> (pos&15)) & 1;
 }
+
 char nio_getch(nio_console* c)
 {
-	int key = 0;
 	while(1)
 	{
+		unsigned short pressed[8];
+		int word;
 		while (!KeyPressed())
+		{
+			NIO_STAT(kbd_polls, 1);
             nio_cursor_blinking_draw(c);
+		}
 		
         nio_cursor_erase(c);
 		keyupdate();
+		for(word = 0; word < 8; word++)
+			pressed[word] = (lastkey[word] ^ holdkey[word]) & lastkey[word];
 
 		// Ctrl, Shift, Caps first
-		if(isKeyPressed(KEY_PRGM_SHIFT))
+		if(nio_key_new(pressed, NIO_KEY(KEY_PRGM_SHIFT)))
 		{
 			if(ctrl) ctrl = FALSE;
 			else ctrl = TRUE;
 		}
-		if(isKeyPressed(68)) // OPTN
+		if(nio_key_new(pressed, NIO_KEY(68))) // OPTN
 		{
 			if(optn) optn = FALSE;
 			else optn = TRUE;
 		}
-		if(isKeyPressed(KEY_PRGM_ALPHA))
+		if(nio_key_new(pressed, NIO_KEY(KEY_PRGM_ALPHA)))
 		{
 			if(ctrl)
 			{
@@ -239,84 +599,33 @@ char nio_getch(nio_console* c)
 			else shift = TRUE;
 		}
 
-		if(isKeyPressed(KEY_PRGM_MENU)) return 0;
-		if(isKeyPressed(KEY_PRGM_EXIT)) return 0;
-		if(isKeyPressed(KEY_PRGM_ACON)) return 0;
-
-		if(isKeyPressed(67)) return shiftKey('`', '$');
-		if(isKeyPressed(57)) return shiftKey('^', '#');
-		
-		// Characters
-		if(isKeyPressed(76)) return lowerOrUpperKey('a', 'A');
-		if(isKeyPressed(66)) return lowerOrUpperKey('b', 'B');
-		if(isKeyPressed(56)) return lowerOrUpperKey('c', 'C');
-		if(isKeyPressed(46)) return lowerOrUpperKey('d', 'D');
-		if(isKeyPressed(36)) return lowerOrUpperKey('e', 'E');
-		if(isKeyPressed(26)) return lowerOrUpperKey('f', 'F');
-
-		if(isKeyPressed(75)) return shiftKey('<', lowerOrUpperKey('g', 'G'));
-		if(isKeyPressed(65)) return shiftKey('>', lowerOrUpperKey('h', 'H'));
-		if(isKeyPressed(55)) return shiftKey('(', lowerOrUpperKey('i', 'I'));
-		if(isKeyPressed(45)) return shiftKey(')', lowerOrUpperKey('j', 'J'));
-		if(isKeyPressed(35)) return shiftKey(',', lowerOrUpperKey('k', 'K'));
-		if(isKeyPressed(25)) return shiftKey('\t', lowerOrUpperKey('l', 'L'));
-
-		if(isKeyPressed(74)) return shiftKey('7', lowerOrUpperKey('m', 'M'));
-		if(isKeyPressed(64)) return shiftKey('8', lowerOrUpperKey('n', 'N'));
-		if(isKeyPressed(54)) return shiftKey('9', lowerOrUpperKey('o', 'O'));
-		if(isKeyPressed(44)) return '\b';
-
-		if(isKeyPressed(73)) return shiftKey('4', lowerOrUpperKey('p', 'P'));
-		if(isKeyPressed(63)) return shiftKey('5', lowerOrUpperKey('q', 'Q'));
-		if(isKeyPressed(53)) return shiftKey('6', lowerOrUpperKey('r', 'R'));
-		if(isKeyPressed(43)) return shiftOrCtrlKey('*', lowerOrUpperKey('s', 'S'), '{');
-		if(isKeyPressed(33)) return shiftOrCtrlKey('/', lowerOrUpperKey('t', 'T'), '}');
-
-		if(isKeyPressed(72)) return shiftKey('1', lowerOrUpperKey('u', 'U'));
-		if(isKeyPressed(62)) return shiftKey('2', lowerOrUpperKey('v', 'V'));
-		if(isKeyPressed(52)) return shiftOrCtrlKey('3', lowerOrUpperKey('w', 'W'), ';');
-		if(isKeyPressed(42)) return shiftOrCtrlKey('+', lowerOrUpperKey('x', 'X'), '[');
-		if(isKeyPressed(32)) return shiftOrCtrlKey('-', lowerOrUpperKey('y', 'Y'), ']');
-
-		if(isKeyPressed(71)) return shiftOrCtrlKey('0', lowerOrUpperKey('z', 'Z'), '|');
-		if(isKeyPressed(61)) return shiftOrCtrlKey('.', ' ', '=');
-		if(isKeyPressed(51)) return shiftOrCtrlKey('_', '"', '?');
-		if(isKeyPressed(41)) return shiftOrCtrlKey('~', ':', '!');
-		if(isKeyPressed(31)) return '\n';
-		
-/*		// Symbols
-		if(isKeyPressed(KEY_CHAR_COMMA))		return shiftKey(',',';');
-		if(isKeyPressed(KEY_CHAR_DP)) 	return shiftKey('.',':');
-		//if(isKeyPressed(KEY_CHAR_COLON))		return ':';
-		if(isKeyPressed(KEY_CHAR_LPAR))			return '(';
-		if(isKeyPressed(KEY_CHAR_RPAR))			return ')';
-		if(isKeyPressed(KEY_CHAR_SPACE))		return shiftKey(' ','_');
-		if(isKeyPressed(KEY_CHAR_DIV))		return shiftKey('/','\\');
-		if(isKeyPressed(KEY_CHAR_MULT))	return shiftKey('*','\"');
-		if(isKeyPressed(KEY_CHAR_MINUS))		return shiftKey('-','_');
-		if(isKeyPressed(KEY_CHAR_PMINUS))	return shiftKey('-','_');
-		if(isKeyPressed(KEY_CHAR_PLUS))		return '+';
-		if(isKeyPressed(KEY_CHAR_EQUAL))		return '=';
-		//if(isKeyPressed(KEY_CHAR_LTHAN))		return '<';
-		//if(isKeyPressed(KEY_CHAR_GTHAN))		return '>';
-		if(isKeyPressed(KEY_CHAR_LBRCKT))		return '[';
-		if(isKeyPressed(KEY_CHAR_RBRCKT))		return ']';
-		if(isKeyPressed(KEY_CHAR_LBRACE))		return '{';
-		if(isKeyPressed(KEY_CHAR_RBRACE))		return '}';
-		if(isKeyPressed(KEY_CHAR_DQUATE))		return '\"';
-		//if(isKeyPressed(KEY_CHAR_APOSTROPHE))	return '\'';
-		//if(isKeyPressed(KEY_CHAR_QUES))		return shiftKey('?','!');
-		//if(isKeyPressed(KEY_CHAR_QUESEXCL))	return shiftKey('?','!');
-		if(isKeyPressed(KEY_CHAR_ANS))		return '|';
-		if(isKeyPressed(KEY_CHAR_EXP))		return '^';
-		if(isKeyPressed(KEY_CTRL_EXE))		return shiftKey('\n','~');
-		if(isKeyPressed(KEY_CHAR_SQUARE))		return '\B2';
-		
-		// Special chars
-		if(isKeyPressed(KEY_CHAR_CR))		return '\n';
-		if(isKeyPressed(KEY_CTRL_DEL))		return '\b';
-		if(isKeyPressed(KEY_CHAR_STORE))		return '\t';
-*/
+		// Only scan the keys that went down
+		for(word = 0; word < 8; word++)
+		{
+			unsigned bits = pressed[word];
+			while(bits)
+			{
+				int bit = 0;
+				int pos, layer;
+				unsigned short entry;
+				while(!(bits & (1 << bit)))
+					bit++;
+				bits &= bits-1;
+				pos = word*16+bit;
+				if(pos >= NIO_KEYMAP_KEYS)
+					continue;
+				layer = (shift || caps ? NIO_KEYMAP_SHIFT : 0) | (ctrl ? NIO_KEYMAP_CTRL : 0) | (optn ? NIO_KEYMAP_OPTN : 0);
+				entry = keymap->keys[layer][pos];
+				if(entry == 0)
+					continue;
+				// Shift and ctrl are used up by a key they change, caps and optn stay on
+				if(shift && keymap->keys[layer & ~NIO_KEYMAP_SHIFT][pos] != entry)
+					shift = FALSE;
+				else if(ctrl && keymap->keys[layer & ~NIO_KEYMAP_CTRL][pos] != entry)
+					ctrl = FALSE;
+				return entry & 0xFF;
+			}
+		}
 	}
 	return 0;
 }
@@ -332,34 +641,116 @@ void nio_init(nio_console* c, const int size_x, const int size_y, const int offs
 	c->drawing_enabled = TRUE;
 	c->default_background_color = background_color;
 	c->default_foreground_color = foreground_color;
-	c->data = malloc(c->max_x*c->max_y);
-	c->color = malloc(c->max_x*c->max_y*2);
-    c->color = malloc(c->max_x*c->max_y);
+	c->palette = nio_default_palette;
+	c->scrollback = NULL;
+	c->compositor = NULL;
+	nio_csl_alloc(c);
     c->cursor_enabled = TRUE;
 	c->cursor_blink_enabled = TRUE;
 	c->cursor_blink_duration = 1;
 	c->cursor_type = 0;
 	c->cursor_line_width = 1;
+	memset(c->cursor_custom_data, 0xFF, 6);
+	c->cursor_blink_status = TRUE;
+	c->cursor_blink_timestamp = nio_time_get();
+	c->cursor_drawn = FALSE;
+	nio_stats_reset(c);
 	nio_clear(c);
 }
 
+void nio_invalidate(nio_console* c)
+{
+	memset(c->dirty,0xFF,NIO_DIRTY_STRIDE(c)*c->max_y);
+}
+
+static inline void nio_csl_mark(nio_console* c, const int pos_x, const int pos_y)
+{
+	c->dirty[pos_y*NIO_DIRTY_STRIDE(c)+(pos_x>>3)] |= 1 << (pos_x&7);
+}
+
+static inline void nio_csl_unmark(nio_console* c, const int pos_x, const int pos_y)
+{
+	c->dirty[pos_y*NIO_DIRTY_STRIDE(c)+(pos_x>>3)] &= ~(1 << (pos_x&7));
+}
+
+void nio_invalidate_rect(nio_console* c, const int x, const int y, const int w, const int h)
+{
+	int first_x, last_x, first_y, last_y, row, col;
+	if(w <= 0 || h <= 0 || x >= c->offset_x+c->max_x*NIO_CHAR_WIDTH || y >= c->offset_y+c->max_y*NIO_CHAR_HEIGHT
+		|| x+w <= c->offset_x || y+h <= c->offset_y)
+		return;
+	first_x = x > c->offset_x ? (x-c->offset_x)/NIO_CHAR_WIDTH : 0;
+	first_y = y > c->offset_y ? (y-c->offset_y)/NIO_CHAR_HEIGHT : 0;
+	last_x = (x+w-1-c->offset_x)/NIO_CHAR_WIDTH;
+	last_y = (y+h-1-c->offset_y)/NIO_CHAR_HEIGHT;
+	if(last_x >= c->max_x) last_x = c->max_x-1;
+	if(last_y >= c->max_y) last_y = c->max_y-1;
+	for(row = first_y; row <= last_y; row++)
+		for(col = first_x; col <= last_x; col++)
+			nio_csl_mark(c,col,row);
+}
+
+static BOOL nio_csl_onscreen(const nio_console* c)
+{
+	return c->offset_x >= 0 && c->offset_x+c->max_x*NIO_CHAR_WIDTH <= LCD_WIDTH_PX
+		&& c->offset_y >= 0 && c->offset_y+c->max_y*NIO_CHAR_HEIGHT <= LCD_HEIGHT_PX;
+}
+
+// Returns TRUE if every cell of the rows first to last is dirty.
+static BOOL nio_csl_rows_dirty(const nio_console* c, const int first, const int last)
+{
+	int stride = NIO_DIRTY_STRIDE(c);
+	unsigned char tail = (c->max_x&7) ? (1 << (c->max_x&7))-1 : 0xFF;
+	int row, i;
+	for(row = first; row <= last; row++)
+	{
+		const unsigned char* bits = c->dirty+row*stride;
+		for(i = 0; i < stride-1; i++)
+			if(bits[i] != 0xFF)
+				return FALSE;
+		if((bits[stride-1] & tail) != tail)
+			return FALSE;
+	}
+	return TRUE;
+}
+
 int nio_fflush(nio_console* c)
 {
-	int row, col;
+	int stride = NIO_DIRTY_STRIDE(c);
+	int row, col, i;
+	int drawn = 0;
+	unsigned start = nio_trace_begin();
+	NIO_STAT(flushes, 1);
+	NIO_CSL_STAT(c, flushes, 1);
+	nio_present_hold();
 	for(row = 0; row < c->max_y; row++)
 	{
-		for(col = 0; col < c->max_x; col++)
+		unsigned char* bits = c->dirty+row*stride;
+		for(i = 0; i < stride; i++)
 		{
-			nio_vram_csl_drawchar(c,col,row);
+			if(bits[i] == 0)
+				continue;
+			for(col = i*8; col < i*8+8 && col < c->max_x; col++)
+			{
+				if(bits[i] & (1 << (col&7)))
+				{
+					nio_vram_csl_drawchar(c,col,row);
+					drawn++;
+				}
+			}
+			bits[i] = 0;
 		}
 	}
-	Bdisp_PutDisp_DD();
+	// Pushes the rows touched since the last present, including a scroll
+	nio_present_release();
+	nio_trace_end(NIO_TRACE_FLUSH, drawn, 0, start);
     return 0;
 }
 
 void nio_clear(nio_console* c)
 {
 	unsigned short color = (c->default_background_color << 8) | c->default_foreground_color;
+	c->head = 0;
 	memset(c->data,0,c->max_x*c->max_y);
 	int i;
 	for(i = 0; i < c->max_x*c->max_y; i++)
@@ -368,68 +759,131 @@ void nio_clear(nio_console* c)
 	}
 	c->cursor_x = 0;
 	c->cursor_y = 0;
+	nio_invalidate(c);
 	if(c->drawing_enabled)
 		nio_fflush(c);
 }
 
 void nio_scroll(nio_console* c)
 {
-	char* temp;
-	unsigned short* temp2;
-	temp = malloc(c->max_x*c->max_y);
-	temp = malloc(c->max_x*c->max_y*2);
-	
-	memset(temp,0,c->max_x*c->max_y);
-	memcpy(temp,c->data+c->max_x,c->max_x*(c->max_y-1));
-	memcpy(c->data,temp,c->max_x*c->max_y);
-	
+	// Rows are stored in a ring: the top row is recycled as the new bottom row.
+	char* data = c->data+c->head*c->max_x;
+	unsigned short* colors = c->color+c->head*c->max_x;
 	unsigned short color = (c->default_background_color << 8) | c->default_foreground_color;
+	unsigned start = nio_trace_begin();
 	int i;
-	for(i = 0; i < c->max_x*c->max_y; i++)
+	
+	NIO_STAT(scrolls, 1);
+	NIO_CSL_STAT(c, scrolls, 1);
+	// The pixels are about to move, take the cursor off them first
+	nio_cursor_erase(c);
+	if(c->scrollback != NULL)
+	{
+		nio_scrollback_view(c,0);
+		nio_scrollback_push(c,data,colors);
+	}
+	memset(data,0,c->max_x);
+	for(i = 0; i < c->max_x; i++)
 	{
-		temp2[i] = color;
+		colors[i] = color;
 	}
-	memcpy(temp2,c->color+c->max_x,c->max_x*(c->max_y-1)*2);
-	memcpy(c->color,temp2,c->max_x*c->max_y*2);
+	if(++c->head == c->max_y)
+		c->head = 0;
 	
 	if(c->cursor_y > 0)
 		c->cursor_y--;
 	c->cursor_x = 0;
 	
-	free(temp);
+	// Unless everything is about to be redrawn anyway, move the pixels
+	// with the cells so only the new bottom row has to be rendered.
+	// In a compositor the pixels may belong to another console, or the
+	// console may be hidden: only the cells drawn by a frame are right.
+	if(c->compositor == NULL && nio_csl_onscreen(c) && !nio_csl_rows_dirty(c,1,c->max_y-1))
+	{
+		int stride = NIO_DIRTY_STRIDE(c);
+		nio_vram_move_up(c->offset_x, c->offset_y, c->max_x*NIO_CHAR_WIDTH, c->max_y*NIO_CHAR_HEIGHT, NIO_CHAR_HEIGHT);
+		NIO_CSL_STAT(c, pixels, (c->max_y-1)*NIO_CHAR_HEIGHT*c->max_x*NIO_CHAR_WIDTH);
+		memmove(c->dirty, c->dirty+stride, stride*(c->max_y-1));
+		memset(c->dirty+stride*(c->max_y-1), 0xFF, stride);
+		nio_trace_end(NIO_TRACE_SCROLL, 1, 0, start);
+	}
+	else
+	{
+		nio_invalidate(c);
+		nio_trace_end(NIO_TRACE_SCROLL, 0, 0, start);
+	}
+}
+
+// Gets a cell as shown on screen, from the scrollback if the console is scrolled back.
+static inline void nio_csl_cell(const nio_console* c, const int pos_x, int pos_y, char* ch, unsigned short* color)
+{
+	if(c->scrollback != NULL && c->scrollback->view_offset)
+	{
+		int offset = c->scrollback->view_offset;
+		if(pos_y < offset)
+		{
+			*ch = c->scrollback->view_data[pos_y*c->max_x+pos_x];
+			*color = c->scrollback->view_color[pos_y*c->max_x+pos_x];
+			return;
+		}
+		pos_y -= offset;
+	}
+	int index = nio_csl_index(c,pos_x,pos_y);
+	*ch = c->data[index];
+	*color = c->color[index];
 }
 
 void nio_csl_drawchar(nio_console* c, const int pos_x, const int pos_y)
 {
-	char ch = c->data[pos_y*c->max_x+pos_x];
-	unsigned short color = c->color[pos_y*c->max_x+pos_x];
+	char ch;
+	unsigned short color;
+	nio_csl_cell(c,pos_x,pos_y,&ch,&color);
 	
 	unsigned char background_color = (color & 0xFF00) >> 8;
 	unsigned char foreground_color = color & 0xFF;
 	
-	nio_grid_putc(c->offset_x, c->offset_y, pos_x, pos_y, ch == 0 ? ' ' : ch, background_color, foreground_color);
+	if(c->cursor_drawn && pos_x == c->cursor_drawn_x && pos_y == c->cursor_drawn_y)
+		c->cursor_drawn = FALSE;
+	nio_csl_unmark(c,pos_x,pos_y);
+	NIO_CSL_STAT(c, glyphs, 1);
+	NIO_CSL_STAT(c, pixels, NIO_CHAR_WIDTH*NIO_CHAR_HEIGHT);
+	NIO_CSL_STAT(c, dd_pixels, NIO_CHAR_WIDTH*NIO_CHAR_HEIGHT);
+	nio_glyph_putc(c->offset_x+pos_x*NIO_CHAR_WIDTH, c->offset_y+pos_y*NIO_CHAR_HEIGHT, ch == 0 ? ' ' : ch, c->palette[background_color], c->palette[foreground_color]);
 }
 
 void nio_vram_csl_drawchar(nio_console* c, const int pos_x, const int pos_y)
 {
-	char ch = c->data[pos_y*c->max_x+pos_x];
-	unsigned short color = c->color[pos_y*c->max_x+pos_x];
+	char ch;
+	unsigned short color;
+	nio_csl_cell(c,pos_x,pos_y,&ch,&color);
 	
 	unsigned char background_color = (color & 0xFF00) >> 8;
 	unsigned char foreground_color = color & 0xFF;
 	
-	nio_vram_grid_putc(c->offset_x, c->offset_y, pos_x, pos_y, ch == 0 ? ' ' : ch, background_color, foreground_color);
+	if(c->cursor_drawn && pos_x == c->cursor_drawn_x && pos_y == c->cursor_drawn_y)
+		c->cursor_drawn = FALSE;
+	nio_csl_unmark(c,pos_x,pos_y);
+	NIO_CSL_STAT(c, glyphs, 1);
+	NIO_CSL_STAT(c, pixels, NIO_CHAR_WIDTH*NIO_CHAR_HEIGHT);
+	nio_vram_glyph_putc(c->offset_x+pos_x*NIO_CHAR_WIDTH, c->offset_y+pos_y*NIO_CHAR_HEIGHT, ch == 0 ? ' ' : ch, c->palette[background_color], c->palette[foreground_color]);
 }
 
 void nio_csl_savechar(nio_console* c, const char ch, const int pos_x, const int pos_y)
 {
 	unsigned short color = (c->default_background_color << 8) | c->default_foreground_color;
 	
-	c->data[pos_y*c->max_x+pos_x] = ch;
-	c->color[pos_y*c->max_x+pos_x] = color;
+	int index = nio_csl_index(c,pos_x,pos_y);
+	
+	// Writing to a console brings it back from the scrollback
+	if(c->scrollback != NULL && c->scrollback->view_offset)
+		nio_scrollback_view(c,0);
+	c->data[index] = ch;
+	c->color[index] = color;
+	nio_csl_mark(c,pos_x,pos_y);
 }
 
-char nio_fputc(char ch, nio_console* c)
+// Commits a char to the cells of a console without drawing it.
+static char nio_csl_putc(nio_console* c, char ch)
 {
 	// Newline. Increment Y cursor, set X cursor to zero. Scroll if necessary.
 	if(ch == '\n')
@@ -438,11 +892,7 @@ char nio_fputc(char ch, nio_console* c)
 		c->cursor_y++;
 		// Scrolling necessary?
 		if(c->cursor_y >= c->max_y)
-		{
 			nio_scroll(c);
-			if(c->drawing_enabled)
-				nio_fflush(c);
-		}
 	}
 	// Carriage return. Set X cursor to zero.
 	else if(ch == '\r')
@@ -471,23 +921,34 @@ char nio_fputc(char ch, nio_console* c)
 			c->cursor_y++;
 		}
 		if(c->cursor_y >= c->max_y)
-		{
 			nio_scroll(c);
-			if(c->drawing_enabled)
-				nio_fflush(c);
-		}
 		// Then store it.
 		nio_csl_savechar(c,ch,c->cursor_x,c->cursor_y);
 		
-		// Draw it when BOOL draw is true
-		if(c->drawing_enabled) nio_csl_drawchar(c,c->cursor_x,c->cursor_y);
-		
 		// Increment X cursor. It will be checked for validity next time.
 		c->cursor_x++;
 	}
     return ch;
 }
 
+void nio_csl_write(nio_console* c, const char* str, const int len)
+{
+	int i;
+	for(i = 0; i < len; i++)
+	{
+		nio_csl_putc(c, str[i]);
+	}
+}
+
+char nio_fputc(char ch, nio_console* c)
+{
+	ch = nio_csl_putc(c, ch);
+	// Draw it when BOOL draw is true
+	if(c->drawing_enabled)
+		nio_fflush(c);
+    return ch;
+}
+
 char nio_putchar(const char ch)
 {
     return nio_fputc(ch,nio_default);
@@ -495,12 +956,13 @@ char nio_putchar(const char ch)
 
 int nio_fputs(const char* str, nio_console* c)
 {
-	int len = strlen(str);
-	int i;
-	for(i = 0; i < len; i++)
-	{
-		nio_fputc(str[i], c);
-	}
+	// Commit the whole string first, then draw the touched cells at once.
+	// A scroll or the cursor may draw on the way, hold the screen until done.
+	nio_present_hold();
+	nio_csl_write(c, str, strlen(str));
+	if(c->drawing_enabled)
+		nio_fflush(c);
+	nio_present_release();
     return 1;
 }
 
@@ -509,28 +971,42 @@ int nio_puts(const char* str)
     return nio_fputs(str,nio_default);
 }
 
+static void nio_csl_sink(void* ctx, const char* str, int len)
+{
+	nio_csl_write((nio_console*)ctx, str, len);
+}
+
+int nio_vfprintf(nio_console* c, const char* format, va_list arglist)
+{
+	int count;
+	// The text comes in pieces, hold the screen until the last one is drawn
+	nio_present_hold();
+	count = nio_vxprintf(nio_csl_sink, c, format, arglist);
+	NIO_CSL_STAT(c, formatted, count);
+	if(c->drawing_enabled)
+		nio_fflush(c);
+	nio_present_release();
+	return count;
+}
+
 int nio_fprintf(nio_console* c, const char *format, ...)
 {
-	char buf[1000];
-	memset(buf,'\0',sizeof(buf));
-	__builtin_va_list arglist;
-	__builtin_va_start(arglist,format);
-	vsprintf(buf,format,*(char **)&arglist);
-	nio_fputs(buf,c);
-	__builtin_va_end(arglist);
-    return strlen(buf);
+	va_list arglist;
+	int count;
+	va_start(arglist,format);
+	count = nio_vfprintf(c,format,arglist);
+	va_end(arglist);
+    return count;
 }
 
 int nio_printf(const char *format, ...)
 {
-	char buf[1000];
-	memset(buf,'\0',sizeof(buf));
-	__builtin_va_list arglist;
-	__builtin_va_start(arglist,format);
-	vsprintf(buf,format,*(char **)&arglist);
-	nio_puts(buf);
-	__builtin_va_end(arglist);
-    return strlen(buf);
+	va_list arglist;
+	int count;
+	va_start(arglist,format);
+	count = nio_vfprintf(nio_default,format,arglist);
+	va_end(arglist);
+    return count;
 }
 
 void nio_perror(const char* str)
@@ -544,6 +1020,19 @@ void nio_color(nio_console* c, const unsigned char background_color, const unsig
 	c->default_foreground_color = foreground_color;
 }
 
+void nio_palette_set(nio_console* c, const unsigned short* palette)
+{
+	c->palette = palette == NULL ? nio_default_palette : palette;
+	nio_invalidate(c);
+	if(c->drawing_enabled)
+		nio_fflush(c);
+}
+
+const unsigned short* nio_palette_get(const nio_console* c)
+{
+	return c->palette;
+}
+
 void nio_drawing_enabled(nio_console* c, const BOOL enable_drawing)
 {
 	c->drawing_enabled = enable_drawing;
@@ -617,6 +1106,6 @@ char* nio_gets(char* str)
 
 void nio_free(nio_console* c)
 {
-	free(c->data);
+	nio_scrollback_disable(c);
 	free(c->color);
 }
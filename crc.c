@@ -0,0 +1,48 @@
+/**
+ * @file crc.c
+ * @author  Julien "Juju" Savard <juju2143@gmail.com>
+ * @author  Julian Mackeben aka compu <compujuckel@googlemail.com>
+ * @version 0.1
+ *
+ * @section LICENSE
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301  USA
+ *
+ * @section DESCRIPTION
+ *
+ * Checksums
+ */
+#include <stdlib.h>
+#include "prizmio.h"
+
+// Nibble-wise tables keep the code small, a 256-entry table would be 1 KB.
+static const unsigned int crc32_table[16] = {
+	0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+	0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C
+};
+
+unsigned int nio_crc32(unsigned int crc, const void* data, size_t len)
+{
+	const unsigned char* p = data;
+	crc = ~crc;
+	while(len--)
+	{
+		crc ^= *p++;
+		crc = (crc >> 4) ^ crc32_table[crc & 0xF];
+		crc = (crc >> 4) ^ crc32_table[crc & 0xF];
+	}
+	return ~crc;
+}
@@ -0,0 +1,182 @@
+/**
+ * @file cursor.c
+ * @author  Julien "Juju" Savard <juju2143@gmail.com>
+ * @author  Julian Mackeben aka compu <compujuckel@googlemail.com>
+ * @version 0.1
+ *
+ * @section LICENSE
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301  USA
+ *
+ * @section DESCRIPTION
+ *
+ * Cursor
+ */
+#include <stdlib.h>
+#include "prizmio.h"
+
+/* The cursor is drawn over its cell in VRAM and erased by drawing the
+ * cell again, so only that cell is ever rendered and only its 8 rows
+ * are presented. cursor_drawn tells where it is on screen, so blinking
+ * only draws when the phase changes.
+ */
+
+// Columns of the cursor, bit n is row n of the cell.
+static void nio_cursor_shape(const nio_console* c, unsigned char* columns)
+{
+	int i;
+	for(i = 0; i < NIO_CHAR_WIDTH; i++)
+	{
+		switch(c->cursor_type)
+		{
+			case NIO_CURSOR_UNDERSCORE:
+				columns[i] = (0xFF << (NIO_CHAR_HEIGHT-c->cursor_line_width)) & 0xFF;
+				break;
+			case NIO_CURSOR_VERTICAL:
+				columns[i] = i < c->cursor_line_width ? 0xFF : 0;
+				break;
+			case NIO_CURSOR_CUSTOM:
+				// Like the glyphs of charmap.h, the top row is left out
+				columns[i] = (c->cursor_custom_data[i] << 1) & 0xFF;
+				break;
+			default:
+				columns[i] = 0xFF;
+				break;
+		}
+	}
+}
+
+static BOOL nio_cursor_visible(const nio_console* c)
+{
+	return c->cursor_enabled && c->drawing_enabled
+		&& c->cursor_x < c->max_x && c->cursor_y < c->max_y
+		&& (c->scrollback == NULL || c->scrollback->view_offset == 0);
+}
+
+void nio_cursor_draw(nio_console* c)
+{
+	unsigned char columns[NIO_CHAR_WIDTH];
+	unsigned short color;
+	int x, y, row, col;
+	if(c->cursor_drawn && (c->cursor_drawn_x != c->cursor_x || c->cursor_drawn_y != c->cursor_y))
+		nio_cursor_erase(c);
+	if(c->cursor_drawn || !nio_cursor_visible(c))
+		return;
+	nio_cursor_shape(c, columns);
+	// The cursor takes the text color of its cell
+	color = c->palette[c->color[((c->head+c->cursor_y)%c->max_y)*c->max_x+c->cursor_x] & 0xFF];
+	x = c->offset_x+c->cursor_x*NIO_CHAR_WIDTH;
+	y = c->offset_y+c->cursor_y*NIO_CHAR_HEIGHT;
+	nio_present_hold();
+	for(row = 0; row < NIO_CHAR_HEIGHT; row++)
+	{
+		for(col = 0; col < NIO_CHAR_WIDTH; col++)
+		{
+			if(columns[col] & (1 << row))
+				nio_vram_rgb_pixel_set(x+col, y+row, color);
+		}
+	}
+	nio_present_release();
+	c->cursor_drawn = TRUE;
+	c->cursor_drawn_x = c->cursor_x;
+	c->cursor_drawn_y = c->cursor_y;
+}
+
+void nio_cursor_erase(nio_console* c)
+{
+	if(!c->cursor_drawn)
+		return;
+	// Drawing the cell clears cursor_drawn
+	nio_csl_drawchar(c, c->cursor_drawn_x, c->cursor_drawn_y);
+}
+
+void nio_cursor_blinking_draw(nio_console* c)
+{
+	if(!c->cursor_enabled)
+		return;
+	if(c->cursor_blink_enabled)
+	{
+		if(nio_time_since(c->cursor_blink_timestamp) >= c->cursor_blink_duration*1000)
+		{
+			c->cursor_blink_status = !c->cursor_blink_status;
+			c->cursor_blink_timestamp = nio_time_get();
+		}
+	}
+	else
+		c->cursor_blink_status = TRUE;
+	// Nothing is drawn unless the phase changed
+	if(c->cursor_blink_status)
+		nio_cursor_draw(c);
+	else
+		nio_cursor_erase(c);
+}
+
+void nio_cursor_blinking_reset(nio_console* c)
+{
+	c->cursor_blink_timestamp = nio_time_get();
+}
+
+void nio_cursor_enable(nio_console* c, BOOL enable_cursor)
+{
+	c->cursor_enabled = enable_cursor;
+	if(!enable_cursor)
+		nio_cursor_erase(c);
+}
+
+void nio_cursor_blinking_enable(nio_console* c, BOOL enable_cursor_blink)
+{
+	c->cursor_blink_enabled = enable_cursor_blink;
+}
+
+void nio_cursor_blinking_duration(nio_console* c, int duration)
+{
+	c->cursor_blink_duration = duration;
+}
+
+// Shows a change of shape right away if the cursor is on screen.
+static void nio_cursor_redraw(nio_console* c)
+{
+	if(c->cursor_drawn)
+	{
+		nio_cursor_erase(c);
+		nio_cursor_draw(c);
+	}
+}
+
+void nio_cursor_type(nio_console* c, int cursor_type)
+{
+	if(cursor_type < NIO_CURSOR_BLOCK || cursor_type > NIO_CURSOR_CUSTOM)
+		cursor_type = NIO_CURSOR_BLOCK;
+	c->cursor_type = cursor_type;
+	nio_cursor_redraw(c);
+}
+
+void nio_cursor_width(nio_console* c, int cursor_width)
+{
+	int max = c->cursor_type == NIO_CURSOR_VERTICAL ? NIO_CHAR_WIDTH : NIO_CHAR_HEIGHT;
+	if(cursor_width <= 0 || cursor_width > max)
+		cursor_width = 1;
+	c->cursor_line_width = cursor_width;
+	nio_cursor_redraw(c);
+}
+
+void nio_cursor_custom(nio_console* c, unsigned char cursor_data[6])
+{
+	int i;
+	for(i = 0; i < 6; i++)
+		c->cursor_custom_data[i] = cursor_data[i];
+	nio_cursor_redraw(c);
+}
@@ -0,0 +1,311 @@
+/**
+ * @file format.c
+ * @author  Julien "Juju" Savard <juju2143@gmail.com>
+ * @author  Julian Mackeben aka compu <compujuckel@googlemail.com>
+ * @version 0.1
+ *
+ * @section LICENSE
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301  USA
+ *
+ * @section DESCRIPTION
+ *
+ * Small printf-style formatter writing straight into a sink
+ */
+#include <stdlib.h>
+#include <stdarg.h>
+#include "prizmio.h"
+
+#define FLAG_LEFT   0x01
+#define FLAG_ZERO   0x02
+#define FLAG_PLUS   0x04
+#define FLAG_SPACE  0x08
+#define FLAG_ALT    0x10
+#define FLAG_UPPER  0x20
+
+static const char digits_lower[] = "0123456789abcdef";
+static const char digits_upper[] = "0123456789ABCDEF";
+static const char pad_spaces[] = "                ";
+static const char pad_zeros[] = "0000000000000000";
+
+static void pad(nio_sink sink, void* ctx, const char* with, int n)
+{
+	while(n > 16)
+	{
+		sink(ctx, with, 16);
+		n -= 16;
+	}
+	if(n > 0)
+		sink(ctx, with, n);
+}
+
+// Writes the digits of n backwards from the end of buf, returns the first one.
+static char* utoa_rev(char* end, unsigned long long n, unsigned base, int flags)
+{
+	const char* digits = (flags & FLAG_UPPER) ? digits_upper : digits_lower;
+	char* p = end;
+	if(base == 16)
+	{
+		do { *--p = digits[n & 0xF]; n >>= 4; } while(n);
+	}
+	else if(base == 8)
+	{
+		do { *--p = digits[n & 0x7]; n >>= 3; } while(n);
+	}
+	else if(n <= 0xFFFFFFFFUL)
+	{
+		// Stay in 32 bits when possible, 64-bit division is slow on the SH3
+		unsigned long m = (unsigned long)n;
+		do { *--p = '0' + m % 10; m /= 10; } while(m);
+	}
+	else
+	{
+		do { *--p = '0' + n % 10; n /= 10; } while(n);
+	}
+	return p;
+}
+
+int nio_vxprintf(nio_sink sink, void* ctx, const char* format, va_list arglist)
+{
+	char buf[24];
+	char* end = buf+sizeof(buf);
+	const char* p = format;
+	int count = 0;
+
+	while(*p)
+	{
+		const char* run = p;
+		int flags = 0, width = 0, precision = -1, length = 0;
+		unsigned long long value;
+		const char* str;
+		const char* prefix = "";
+		int len, prefix_len = 0, zeros = 0;
+
+		// Literal text is passed to the sink as is
+		while(*p && *p != '%')
+			p++;
+		if(p > run)
+		{
+			sink(ctx, run, p-run);
+			count += p-run;
+		}
+		if(!*p)
+			break;
+		run = p++;
+
+		// Flags, width, precision and length
+		for(;; p++)
+		{
+			if(*p == '-') flags |= FLAG_LEFT;
+			else if(*p == '0') flags |= FLAG_ZERO;
+			else if(*p == '+') flags |= FLAG_PLUS;
+			else if(*p == ' ') flags |= FLAG_SPACE;
+			else if(*p == '#') flags |= FLAG_ALT;
+			else break;
+		}
+		if(*p == '*')
+		{
+			width = va_arg(arglist, int);
+			if(width < 0)
+			{
+				flags |= FLAG_LEFT;
+				width = -width;
+			}
+			p++;
+		}
+		else while(*p >= '0' && *p <= '9')
+			width = width*10 + *p++ - '0';
+		if(*p == '.')
+		{
+			p++;
+			precision = 0;
+			if(*p == '*')
+			{
+				precision = va_arg(arglist, int);
+				p++;
+			}
+			else while(*p >= '0' && *p <= '9')
+				precision = precision*10 + *p++ - '0';
+		}
+		// length is -2 for hh, -1 for h, 0 for int, 1 for l and 2 for ll
+		while(*p == 'h' || *p == 'l' || *p == 'z' || *p == 't' || *p == 'j')
+		{
+			if(*p == 'h') length--;
+			else if(*p == 'l' || *p == 'j') length++;
+			else if(*p == 'z' || *p == 't') length = 1;
+			p++;
+		}
+
+		switch(*p)
+		{
+			case 'd':
+			case 'i':
+			{
+				long long n = length >= 2 ? va_arg(arglist, long long) : length == 1 ? va_arg(arglist, long) : va_arg(arglist, int);
+				// short and char are promoted to int, cut them back
+				if(length == -1) n = (short)n;
+				else if(length <= -2) n = (signed char)n;
+				value = n < 0 ? -(unsigned long long)n : (unsigned long long)n;
+				str = utoa_rev(end, value, 10, flags);
+				if(n < 0) prefix = "-";
+				else if(flags & FLAG_PLUS) prefix = "+";
+				else if(flags & FLAG_SPACE) prefix = " ";
+				prefix_len = *prefix ? 1 : 0;
+				break;
+			}
+			case 'u':
+			case 'x':
+			case 'X':
+			case 'o':
+			case 'p':
+			{
+				unsigned base = *p == 'u' ? 10 : *p == 'o' ? 8 : 16;
+				if(*p == 'p')
+				{
+					value = (unsigned long)va_arg(arglist, void*);
+					flags |= FLAG_ALT;
+				}
+				else
+					value = length >= 2 ? va_arg(arglist, unsigned long long) : length == 1 ? va_arg(arglist, unsigned long) : va_arg(arglist, unsigned int);
+				if(length == -1) value = (unsigned short)value;
+				else if(length <= -2) value = (unsigned char)value;
+				if(*p == 'X')
+					flags |= FLAG_UPPER;
+				str = utoa_rev(end, value, base, flags);
+				if((flags & FLAG_ALT) && base == 16 && value != 0)
+				{
+					prefix = (flags & FLAG_UPPER) ? "0X" : "0x";
+					prefix_len = 2;
+				}
+				else if((flags & FLAG_ALT) && base == 8 && *str != '0')
+				{
+					prefix = "0";
+					prefix_len = 1;
+				}
+				break;
+			}
+			case 'c':
+				buf[0] = (char)va_arg(arglist, int);
+				str = buf;
+				end = buf+1;
+				precision = -1;
+				break;
+			case 's':
+				str = va_arg(arglist, const char*);
+				if(str == NULL)
+					str = "(null)";
+				// Like strnlen, the string may not be terminated if a precision is given
+				for(len = 0; (precision < 0 || len < precision) && str[len]; len++);
+				end = (char*)str+len;
+				precision = -1;
+				break;
+			case '%':
+				sink(ctx, "%", 1);
+				count++;
+				p++;
+				continue;
+			case 'f':
+			case 'F':
+			case 'e':
+			case 'E':
+			case 'g':
+			case 'G':
+			case 'a':
+			case 'A':
+				// Floating point is not supported, but the argument is still
+				// taken so the ones after it stay in place
+				(void)va_arg(arglist, double);
+				p++;
+				sink(ctx, run, p-run);
+				count += p-run;
+				continue;
+			default:
+				// Unsupported conversion, write it out verbatim
+				if(*p)
+					p++;
+				sink(ctx, run, p-run);
+				count += p-run;
+				continue;
+		}
+		p++;
+
+		len = end-str;
+		if(precision >= 0)
+		{
+			// An explicit precision disables zero padding, and %.0d of 0 prints nothing
+			flags &= ~FLAG_ZERO;
+			if(precision == 0 && len == 1 && *str == '0')
+				len = 0;
+			if(precision > len)
+				zeros = precision-len;
+		}
+		if((flags & FLAG_ZERO) && !(flags & FLAG_LEFT) && width > prefix_len+len)
+			zeros = width-prefix_len-len;
+		width -= prefix_len+zeros+len;
+
+		if(!(flags & FLAG_LEFT))
+			pad(sink, ctx, pad_spaces, width);
+		if(prefix_len)
+			sink(ctx, prefix, prefix_len);
+		pad(sink, ctx, pad_zeros, zeros);
+		if(len)
+			sink(ctx, str, len);
+		if(flags & FLAG_LEFT)
+			pad(sink, ctx, pad_spaces, width);
+		count += prefix_len+zeros+len+(width > 0 ? width : 0);
+		end = buf+sizeof(buf);
+	}
+	NIO_STAT(formatted, count);
+	return count;
+}
+
+struct string_sink
+{
+	char* str;
+	size_t size;
+	size_t pos;
+};
+
+static void string_write(void* ctx, const char* str, int len)
+{
+	struct string_sink* s = ctx;
+	while(len-- > 0)
+	{
+		if(s->pos+1 < s->size)
+			s->str[s->pos] = *str;
+		s->pos++;
+		str++;
+	}
+}
+
+int nio_vsnprintf(char* str, size_t size, const char* format, va_list arglist)
+{
+	struct string_sink s = {str, size, 0};
+	int count = nio_vxprintf(string_write, &s, format, arglist);
+	if(size > 0)
+		str[s.pos < size ? s.pos : size-1] = '\0';
+	return count;
+}
+
+int nio_snprintf(char* str, size_t size, const char* format, ...)
+{
+	va_list arglist;
+	int count;
+	va_start(arglist, format);
+	count = nio_vsnprintf(str, size, format, arglist);
+	va_end(arglist);
+	return count;
+}
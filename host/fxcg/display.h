@@ -0,0 +1,39 @@
+/**
+ * @file display.h
+ * @author  Julien "Juju" Savard <juju2143@gmail.com>
+ * @version 0.1
+ *
+ * @section LICENSE
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301  USA
+ *
+ * @section DESCRIPTION
+ *
+ * Host stand-in for the display calls of libfxcg
+ */
+#ifndef HOST_FXCG_DISPLAY_H
+#define HOST_FXCG_DISPLAY_H
+
+#define LCD_WIDTH_PX 384
+#define LCD_HEIGHT_PX 216
+
+void* GetVRAMAddress(void);
+void Bdisp_AllClr_VRAM(void);
+void Bdisp_PutDisp_DD(void);
+void Bdisp_PutDisp_DD_stripe(int y1, int y2);
+void Bdisp_SetPoint_DD(int x, int y, int color);
+
+#endif
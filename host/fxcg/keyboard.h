@@ -0,0 +1,45 @@
+/**
+ * @file keyboard.h
+ * @author  Julien "Juju" Savard <juju2143@gmail.com>
+ * @version 0.1
+ *
+ * @section LICENSE
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301  USA
+ *
+ * @section DESCRIPTION
+ *
+ * Host stand-in for the keyboard calls of libfxcg
+ */
+#ifndef HOST_FXCG_KEYBOARD_H
+#define HOST_FXCG_KEYBOARD_H
+
+#define KEY_PRGM_ACON 10
+#define KEY_PRGM_DOWN 37
+#define KEY_PRGM_EXIT 47
+#define KEY_PRGM_MENU 48
+#define KEY_PRGM_LEFT 38
+#define KEY_PRGM_RIGHT 27
+#define KEY_PRGM_UP 28
+#define KEY_PRGM_ALPHA 77
+#define KEY_PRGM_SHIFT 78
+
+/* Keyboard matrix, in place of the register at 0xA44B0000. */
+extern unsigned short host_keyboard[8];
+
+int KeyPressed(void);
+
+#endif
@@ -0,0 +1,42 @@
+/**
+ * @file serial.h
+ * @author  Julien "Juju" Savard <juju2143@gmail.com>
+ * @version 0.1
+ *
+ * @section LICENSE
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301  USA
+ *
+ * @section DESCRIPTION
+ *
+ * Host stand-in for the serial calls of libfxcg
+ */
+#ifndef HOST_FXCG_SERIAL_H
+#define HOST_FXCG_SERIAL_H
+
+int Serial_Open(unsigned char* mode);
+int Serial_Close(int mode);
+int Serial_IsOpen(void);
+int Serial_Read(unsigned char* out, int sz, short* count);
+int Serial_ReadSingle(unsigned char* out);
+int Serial_PollRX(void);
+int Serial_PollTX(void);
+int Serial_ClearRX(void);
+int Serial_ClearTX(void);
+int Serial_Write(const unsigned char* buf, int count);
+int Serial_WriteSingle(unsigned char x);
+
+#endif
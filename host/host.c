@@ -0,0 +1,277 @@
+/**
+ * @file host.c
+ * @author  Julien "Juju" Savard <juju2143@gmail.com>
+ * @version 0.1
+ *
+ * @section LICENSE
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301  USA
+ *
+ * @section DESCRIPTION
+ *
+ * Host backend: in-memory VRAM and screen, and stand-ins for the
+ * libfxcg calls used by the library, so it runs on a computer.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <fxcg/display.h>
+#include <fxcg/keyboard.h>
+#include <fxcg/rtc.h>
+#include <fxcg/serial.h>
+#include "prizmio_host.h"
+
+static unsigned short host_vram[LCD_WIDTH_PX*LCD_HEIGHT_PX];
+unsigned short host_screen[LCD_WIDTH_PX*LCD_HEIGHT_PX];
+unsigned short host_keyboard[8];
+
+int host_presents = 0;
+long host_present_rows = 0;
+int host_setpoints = 0;
+struct host_present host_present_log[HOST_PRESENT_LOG];
+void (*host_key_idle)(void) = NULL;
+
+void host_present_reset(void)
+{
+	host_presents = 0;
+	host_present_rows = 0;
+	host_setpoints = 0;
+}
+
+static void host_present(int y1, int y2)
+{
+	if(y1 < 0) y1 = 0;
+	if(y2 >= LCD_HEIGHT_PX) y2 = LCD_HEIGHT_PX-1;
+	if(y1 > y2)
+		return;
+	memcpy(host_screen+y1*LCD_WIDTH_PX, host_vram+y1*LCD_WIDTH_PX, (y2-y1+1)*LCD_WIDTH_PX*sizeof(unsigned short));
+	if(host_presents < HOST_PRESENT_LOG)
+	{
+		host_present_log[host_presents].y1 = y1;
+		host_present_log[host_presents].y2 = y2;
+	}
+	host_presents++;
+	host_present_rows += y2-y1+1;
+}
+
+void* GetVRAMAddress(void)
+{
+	return host_vram;
+}
+
+void Bdisp_AllClr_VRAM(void)
+{
+	memset(host_vram, 0xFF, sizeof(host_vram));
+}
+
+void Bdisp_PutDisp_DD(void)
+{
+	host_present(0, LCD_HEIGHT_PX-1);
+}
+
+void Bdisp_PutDisp_DD_stripe(int y1, int y2)
+{
+	host_present(y1, y2);
+}
+
+void Bdisp_SetPoint_DD(int x, int y, int color)
+{
+	if(x >= 0 && x < LCD_WIDTH_PX && y >= 0 && y < LCD_HEIGHT_PX)
+		host_screen[y*LCD_WIDTH_PX+x] = color;
+	host_setpoints++;
+}
+
+int host_dump_ppm(const char* path, int vram)
+{
+	const unsigned short* src = vram ? host_vram : host_screen;
+	unsigned char row[LCD_WIDTH_PX*3];
+	int x, y;
+	FILE* f = fopen(path, "wb");
+	if(f == NULL)
+		return -1;
+	fprintf(f, "P6\n%d %d\n255\n", LCD_WIDTH_PX, LCD_HEIGHT_PX);
+	for(y = 0; y < LCD_HEIGHT_PX; y++)
+	{
+		// RGB565 to 8 bits per channel, repeating the high bits
+		for(x = 0; x < LCD_WIDTH_PX; x++)
+		{
+			unsigned short c = src[y*LCD_WIDTH_PX+x];
+			unsigned r = c >> 11, g = (c >> 5) & 0x3F, b = c & 0x1F;
+			row[x*3] = r << 3 | r >> 2;
+			row[x*3+1] = g << 2 | g >> 4;
+			row[x*3+2] = b << 3 | b >> 2;
+		}
+		if(fwrite(row, 1, sizeof(row), f) != sizeof(row))
+		{
+			fclose(f);
+			return -1;
+		}
+	}
+	return fclose(f) == 0 ? 0 : -1;
+}
+
+void host_key_set(int basic_keycode, int down)
+{
+	int row = basic_keycode%10;
+	int col = basic_keycode/10-1;
+	unsigned short bit = 1 << (col+8*(row&1));
+	if(down)
+		host_keyboard[row>>1] |= bit;
+	else
+		host_keyboard[row>>1] &= ~bit;
+}
+
+int KeyPressed(void)
+{
+	int i;
+	for(i = 0; i < 8; i++)
+	{
+		if(host_keyboard[i])
+			return 1;
+	}
+	if(host_key_idle != NULL)
+		host_key_idle();
+	return 0;
+}
+
+int RTC_GetTicks(void)
+{
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec*128+t.tv_nsec/7812500;
+}
+
+/* The serial port is a loopback through a buffer the size of the one of
+ * the OS, or a pair of file descriptors.
+ */
+#define HOST_SERIAL_SIZE 256
+
+static unsigned char serial_buffer[HOST_SERIAL_SIZE];
+static int serial_head = 0;
+static int serial_count = 0;
+static int serial_open = 0;
+static int serial_in = -1;
+static int serial_out = -1;
+
+void host_serial_fds(int in, int out)
+{
+	serial_in = in;
+	serial_out = out;
+	if(in >= 0)
+		fcntl(in, F_SETFL, fcntl(in, F_GETFL) | O_NONBLOCK);
+	if(out >= 0)
+		fcntl(out, F_SETFL, fcntl(out, F_GETFL) | O_NONBLOCK);
+}
+
+int Serial_Open(unsigned char* mode)
+{
+	serial_open = 1;
+	return 0;
+}
+
+int Serial_Close(int mode)
+{
+	serial_open = 0;
+	return 0;
+}
+
+int Serial_IsOpen(void)
+{
+	return serial_open ? 1 : 3;
+}
+
+int Serial_PollRX(void)
+{
+	if(serial_in >= 0)
+	{
+		int n = 0;
+		if(ioctl(serial_in, FIONREAD, &n) != 0)
+			return 0;
+		return n < HOST_SERIAL_SIZE ? n : HOST_SERIAL_SIZE;
+	}
+	return serial_count;
+}
+
+int Serial_PollTX(void)
+{
+	if(serial_out >= 0)
+		return HOST_SERIAL_SIZE;
+	return HOST_SERIAL_SIZE-serial_count;
+}
+
+int Serial_Read(unsigned char* out, int sz, short* count)
+{
+	int n = 0;
+	if(serial_in >= 0)
+	{
+		n = read(serial_in, out, sz);
+		if(n < 0)
+			n = 0;
+	}
+	else
+	{
+		while(n < sz && serial_count > 0)
+		{
+			out[n++] = serial_buffer[serial_head];
+			serial_head = (serial_head+1)%HOST_SERIAL_SIZE;
+			serial_count--;
+		}
+	}
+	*count = n;
+	return 0;
+}
+
+int Serial_ReadSingle(unsigned char* out)
+{
+	short count;
+	Serial_Read(out, 1, &count);
+	return count == 1 ? 0 : 1;
+}
+
+int Serial_Write(const unsigned char* buf, int count)
+{
+	int i;
+	if(serial_out >= 0)
+	{
+		// Like the OS, all or nothing
+		return write(serial_out, buf, count) == count ? 0 : 2;
+	}
+	if(count > HOST_SERIAL_SIZE-serial_count)
+		return 2;
+	for(i = 0; i < count; i++)
+		serial_buffer[(serial_head+serial_count++)%HOST_SERIAL_SIZE] = buf[i];
+	return 0;
+}
+
+int Serial_WriteSingle(unsigned char x)
+{
+	return Serial_Write(&x, 1);
+}
+
+int Serial_ClearRX(void)
+{
+	serial_head = 0;
+	serial_count = 0;
+	return 0;
+}
+
+int Serial_ClearTX(void)
+{
+	return 0;
+}
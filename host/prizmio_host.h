@@ -0,0 +1,85 @@
+/**
+ * @file prizmio_host.h
+ * @author  Julien "Juju" Savard <juju2143@gmail.com>
+ * @version 0.1
+ *
+ * @section LICENSE
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301  USA
+ *
+ * @section DESCRIPTION
+ *
+ * Control of the host backend, for tests and profiling on a computer
+ */
+#ifndef PRIZMIO_HOST_H
+#define PRIZMIO_HOST_H
+
+#include <fxcg/display.h>
+
+/** Size of the log of presents. */
+#define HOST_PRESENT_LOG 256
+
+/** A present: rows y1 to y2 were pushed to the screen. */
+struct host_present
+{
+	int y1;
+	int y2;
+};
+
+/** What the screen shows, updated by the presents. */
+extern unsigned short host_screen[LCD_WIDTH_PX*LCD_HEIGHT_PX];
+
+/** Number of presents since host_present_reset(). */
+extern int host_presents;
+
+/** Number of rows pushed to the screen since host_present_reset(). */
+extern long host_present_rows;
+
+/** Number of Bdisp_SetPoint_DD() calls since host_present_reset(). */
+extern int host_setpoints;
+
+/** The first HOST_PRESENT_LOG presents since host_present_reset(). */
+extern struct host_present host_present_log[HOST_PRESENT_LOG];
+
+/** Resets the present counters and log. */
+void host_present_reset(void);
+
+/** Writes the screen, or the VRAM, to a binary PPM file.
+	@param path File path
+	@param vram Nonzero to dump the VRAM instead of the screen
+	@return 0 on success, -1 on failure
+*/
+int host_dump_ppm(const char* path, int vram);
+
+/** Presses or releases a key.
+	@param basic_keycode Key, as used by isKeyPressed()
+	@param down Nonzero to press it
+*/
+void host_key_set(int basic_keycode, int down);
+
+/** Called by KeyPressed() when no key is down, so a program can feed keys while a
+	console waits for input. NULL by default.
+*/
+extern void (*host_key_idle)(void);
+
+/** Connects the serial port to file descriptors, such as a pipe or a pty. By default
+	the port is a loopback: what is written is read back.
+	@param in Descriptor read from, -1 for the loopback
+	@param out Descriptor written to, -1 for the loopback
+*/
+void host_serial_fds(int in, int out);
+
+#endif
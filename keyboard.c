@@ -0,0 +1,167 @@
+/**
+ * @file keyboard.c
+ * @author  Julien "Juju" Savard <juju2143@gmail.com>
+ * @author  Julian Mackeben aka compu <compujuckel@googlemail.com>
+ * @version 0.1
+ *
+ * @section LICENSE
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301  USA
+ *
+ * @section DESCRIPTION
+ *
+ * Keyboard events and typematic repeat
+ */
+#include <stdlib.h>
+#include "prizmio.h"
+
+extern const unsigned short* keyboard_register;
+
+static nio_kbd_event kbd_queue[NIO_KBD_QUEUE];
+static int kbd_head = 0;  // next event read
+static int kbd_count = 0;
+static unsigned short kbd_state[8];
+
+// Typematic repeat of the last key pressed, in ms
+static int kbd_delay = 500;
+static int kbd_period = 100;
+static int kbd_repeat_key = -1;
+static unsigned kbd_repeat_time; // of the press or of the last repeat
+static int kbd_repeat_wait;      // from kbd_repeat_time to the next repeat
+
+// Removes the oldest repeat from the queue, FALSE if there is none.
+static BOOL kbd_drop_repeat(void)
+{
+	int i, j;
+	for(i = 0; i < kbd_count; i++)
+	{
+		if(kbd_queue[(kbd_head+i)%NIO_KBD_QUEUE].type == NIO_KBD_REPEAT)
+			break;
+	}
+	if(i == kbd_count)
+		return FALSE;
+	for(j = i; j < kbd_count-1; j++)
+		kbd_queue[(kbd_head+j)%NIO_KBD_QUEUE] = kbd_queue[(kbd_head+j+1)%NIO_KBD_QUEUE];
+	kbd_count--;
+	return TRUE;
+}
+
+static void kbd_push(const int type, const int key, const unsigned time)
+{
+	nio_kbd_event* e;
+	// A full queue drops new repeats, the old events are what the program
+	// is behind on. Presses and releases take the place of a repeat, and a
+	// release goes in anyway, so a key is never left down.
+	if(kbd_count == NIO_KBD_QUEUE && (type == NIO_KBD_REPEAT || !kbd_drop_repeat()))
+	{
+		if(type != NIO_KBD_RELEASE)
+			return;
+		kbd_head = (kbd_head+1)%NIO_KBD_QUEUE;
+		kbd_count--;
+	}
+	nio_trace(NIO_TRACE_KEY, type, key);
+	e = &kbd_queue[(kbd_head+kbd_count)%NIO_KBD_QUEUE];
+	e->type = type;
+	e->key = key;
+	e->time = time;
+	kbd_count++;
+}
+
+void nio_kbd_scan(void)
+{
+	unsigned time = nio_time_get();
+	int word;
+	NIO_STAT(kbd_polls, 1);
+	for(word = 0; word < 8; word++)
+	{
+		unsigned short now = keyboard_register[word];
+		unsigned changed = now ^ kbd_state[word];
+		kbd_state[word] = now;
+		while(changed)
+		{
+			int bit = 0;
+			int key;
+			while(!(changed & (1 << bit)))
+				bit++;
+			changed &= changed-1;
+			key = word*16+bit;
+			if(now & (1 << bit))
+			{
+				kbd_push(NIO_KBD_PRESS, key, time);
+				kbd_repeat_key = key;
+				kbd_repeat_time = time;
+				kbd_repeat_wait = kbd_delay;
+			}
+			else
+			{
+				kbd_push(NIO_KBD_RELEASE, key, time);
+				if(key == kbd_repeat_key)
+					kbd_repeat_key = -1;
+			}
+		}
+	}
+	// One repeat at most, a late scan does not make up for the ones it missed
+	if(kbd_repeat_key >= 0 && kbd_delay > 0 && nio_time_since(kbd_repeat_time) >= (unsigned)kbd_repeat_wait)
+	{
+		kbd_push(NIO_KBD_REPEAT, kbd_repeat_key, time);
+		kbd_repeat_time = time;
+		kbd_repeat_wait = kbd_period;
+	}
+}
+
+BOOL nio_kbd_poll(nio_kbd_event* e)
+{
+	nio_kbd_scan();
+	if(kbd_count == 0)
+		return FALSE;
+	*e = kbd_queue[kbd_head];
+	kbd_head = (kbd_head+1)%NIO_KBD_QUEUE;
+	kbd_count--;
+	return TRUE;
+}
+
+BOOL nio_kbd_wait(nio_kbd_event* e, const int timeout)
+{
+	unsigned start = nio_time_get();
+	while(!nio_kbd_poll(e))
+	{
+		if(timeout >= 0 && nio_time_since(start) >= (unsigned)timeout)
+			return FALSE;
+	}
+	return TRUE;
+}
+
+void nio_kbd_repeat(const int delay, const int period)
+{
+	kbd_delay = delay;
+	kbd_period = period > 0 ? period : 1;
+}
+
+void nio_kbd_clear(void)
+{
+	int word;
+	// Keys already down do not make events
+	for(word = 0; word < 8; word++)
+		kbd_state[word] = keyboard_register[word];
+	kbd_head = 0;
+	kbd_count = 0;
+	kbd_repeat_key = -1;
+}
+
+BOOL nio_kbd_down(const int key)
+{
+	return (kbd_state[key>>4] >> (key&15)) & 1;
+}
@@ -0,0 +1,340 @@
+/**
+ * @file keymap.h
+ * @author  Julien "Juju" Savard <juju2143@gmail.com>
+ * @version 0.1
+ *
+ * @section LICENSE
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301  USA
+ *
+ * @section DESCRIPTION
+ *
+ * This file contains the default keymap of nio_getch(). Each layer maps
+ * the keys, by position in the keyboard matrix, to the char they type
+ * with a set of modifiers. ALPHA gives the SHIFT layer, SHIFT the CTRL
+ * layer and OPTN the OPTN layer. MENU, EXIT and AC/ON type a null char.
+ */
+
+#ifndef KEYMAP_H
+#define KEYMAP_H
+
+const nio_keymap nio_default_keymap = {{
+	/* none */ {
+		[NIO_KEY(10)] = NIO_KEYMAP_CHAR(0),
+		[NIO_KEY(48)] = NIO_KEYMAP_CHAR(0),
+		[NIO_KEY(47)] = NIO_KEYMAP_CHAR(0),
+		[NIO_KEY(67)] = NIO_KEYMAP_CHAR('`'),
+		[NIO_KEY(57)] = NIO_KEYMAP_CHAR('^'),
+		[NIO_KEY(76)] = NIO_KEYMAP_CHAR('a'),
+		[NIO_KEY(66)] = NIO_KEYMAP_CHAR('b'),
+		[NIO_KEY(56)] = NIO_KEYMAP_CHAR('c'),
+		[NIO_KEY(46)] = NIO_KEYMAP_CHAR('d'),
+		[NIO_KEY(36)] = NIO_KEYMAP_CHAR('e'),
+		[NIO_KEY(26)] = NIO_KEYMAP_CHAR('f'),
+		[NIO_KEY(75)] = NIO_KEYMAP_CHAR('<'),
+		[NIO_KEY(65)] = NIO_KEYMAP_CHAR('>'),
+		[NIO_KEY(55)] = NIO_KEYMAP_CHAR('('),
+		[NIO_KEY(45)] = NIO_KEYMAP_CHAR(')'),
+		[NIO_KEY(35)] = NIO_KEYMAP_CHAR(','),
+		[NIO_KEY(25)] = NIO_KEYMAP_CHAR('\t'),
+		[NIO_KEY(74)] = NIO_KEYMAP_CHAR('7'),
+		[NIO_KEY(64)] = NIO_KEYMAP_CHAR('8'),
+		[NIO_KEY(54)] = NIO_KEYMAP_CHAR('9'),
+		[NIO_KEY(44)] = NIO_KEYMAP_CHAR('\b'),
+		[NIO_KEY(73)] = NIO_KEYMAP_CHAR('4'),
+		[NIO_KEY(63)] = NIO_KEYMAP_CHAR('5'),
+		[NIO_KEY(53)] = NIO_KEYMAP_CHAR('6'),
+		[NIO_KEY(43)] = NIO_KEYMAP_CHAR('*'),
+		[NIO_KEY(33)] = NIO_KEYMAP_CHAR('/'),
+		[NIO_KEY(72)] = NIO_KEYMAP_CHAR('1'),
+		[NIO_KEY(62)] = NIO_KEYMAP_CHAR('2'),
+		[NIO_KEY(52)] = NIO_KEYMAP_CHAR('3'),
+		[NIO_KEY(42)] = NIO_KEYMAP_CHAR('+'),
+		[NIO_KEY(32)] = NIO_KEYMAP_CHAR('-'),
+		[NIO_KEY(71)] = NIO_KEYMAP_CHAR('0'),
+		[NIO_KEY(61)] = NIO_KEYMAP_CHAR('.'),
+		[NIO_KEY(51)] = NIO_KEYMAP_CHAR('_'),
+		[NIO_KEY(41)] = NIO_KEYMAP_CHAR('~'),
+		[NIO_KEY(31)] = NIO_KEYMAP_CHAR('\n')
+	},
+	/* SHIFT */ {
+		[NIO_KEY(10)] = NIO_KEYMAP_CHAR(0),
+		[NIO_KEY(48)] = NIO_KEYMAP_CHAR(0),
+		[NIO_KEY(47)] = NIO_KEYMAP_CHAR(0),
+		[NIO_KEY(67)] = NIO_KEYMAP_CHAR('$'),
+		[NIO_KEY(57)] = NIO_KEYMAP_CHAR('#'),
+		[NIO_KEY(76)] = NIO_KEYMAP_CHAR('a'),
+		[NIO_KEY(66)] = NIO_KEYMAP_CHAR('b'),
+		[NIO_KEY(56)] = NIO_KEYMAP_CHAR('c'),
+		[NIO_KEY(46)] = NIO_KEYMAP_CHAR('d'),
+		[NIO_KEY(36)] = NIO_KEYMAP_CHAR('e'),
+		[NIO_KEY(26)] = NIO_KEYMAP_CHAR('f'),
+		[NIO_KEY(75)] = NIO_KEYMAP_CHAR('g'),
+		[NIO_KEY(65)] = NIO_KEYMAP_CHAR('h'),
+		[NIO_KEY(55)] = NIO_KEYMAP_CHAR('i'),
+		[NIO_KEY(45)] = NIO_KEYMAP_CHAR('j'),
+		[NIO_KEY(35)] = NIO_KEYMAP_CHAR('k'),
+		[NIO_KEY(25)] = NIO_KEYMAP_CHAR('l'),
+		[NIO_KEY(74)] = NIO_KEYMAP_CHAR('m'),
+		[NIO_KEY(64)] = NIO_KEYMAP_CHAR('n'),
+		[NIO_KEY(54)] = NIO_KEYMAP_CHAR('o'),
+		[NIO_KEY(44)] = NIO_KEYMAP_CHAR('\b'),
+		[NIO_KEY(73)] = NIO_KEYMAP_CHAR('p'),
+		[NIO_KEY(63)] = NIO_KEYMAP_CHAR('q'),
+		[NIO_KEY(53)] = NIO_KEYMAP_CHAR('r'),
+		[NIO_KEY(43)] = NIO_KEYMAP_CHAR('s'),
+		[NIO_KEY(33)] = NIO_KEYMAP_CHAR('t'),
+		[NIO_KEY(72)] = NIO_KEYMAP_CHAR('u'),
+		[NIO_KEY(62)] = NIO_KEYMAP_CHAR('v'),
+		[NIO_KEY(52)] = NIO_KEYMAP_CHAR('w'),
+		[NIO_KEY(42)] = NIO_KEYMAP_CHAR('x'),
+		[NIO_KEY(32)] = NIO_KEYMAP_CHAR('y'),
+		[NIO_KEY(71)] = NIO_KEYMAP_CHAR('z'),
+		[NIO_KEY(61)] = NIO_KEYMAP_CHAR(' '),
+		[NIO_KEY(51)] = NIO_KEYMAP_CHAR('"'),
+		[NIO_KEY(41)] = NIO_KEYMAP_CHAR(':'),
+		[NIO_KEY(31)] = NIO_KEYMAP_CHAR('\n')
+	},
+	/* CTRL */ {
+		[NIO_KEY(10)] = NIO_KEYMAP_CHAR(0),
+		[NIO_KEY(48)] = NIO_KEYMAP_CHAR(0),
+		[NIO_KEY(47)] = NIO_KEYMAP_CHAR(0),
+		[NIO_KEY(67)] = NIO_KEYMAP_CHAR('`'),
+		[NIO_KEY(57)] = NIO_KEYMAP_CHAR('^'),
+		[NIO_KEY(76)] = NIO_KEYMAP_CHAR('a'),
+		[NIO_KEY(66)] = NIO_KEYMAP_CHAR('b'),
+		[NIO_KEY(56)] = NIO_KEYMAP_CHAR('c'),
+		[NIO_KEY(46)] = NIO_KEYMAP_CHAR('d'),
+		[NIO_KEY(36)] = NIO_KEYMAP_CHAR('e'),
+		[NIO_KEY(26)] = NIO_KEYMAP_CHAR('f'),
+		[NIO_KEY(75)] = NIO_KEYMAP_CHAR('<'),
+		[NIO_KEY(65)] = NIO_KEYMAP_CHAR('>'),
+		[NIO_KEY(55)] = NIO_KEYMAP_CHAR('('),
+		[NIO_KEY(45)] = NIO_KEYMAP_CHAR(')'),
+		[NIO_KEY(35)] = NIO_KEYMAP_CHAR(','),
+		[NIO_KEY(25)] = NIO_KEYMAP_CHAR('\t'),
+		[NIO_KEY(74)] = NIO_KEYMAP_CHAR('7'),
+		[NIO_KEY(64)] = NIO_KEYMAP_CHAR('8'),
+		[NIO_KEY(54)] = NIO_KEYMAP_CHAR('9'),
+		[NIO_KEY(44)] = NIO_KEYMAP_CHAR('\b'),
+		[NIO_KEY(73)] = NIO_KEYMAP_CHAR('4'),
+		[NIO_KEY(63)] = NIO_KEYMAP_CHAR('5'),
+		[NIO_KEY(53)] = NIO_KEYMAP_CHAR('6'),
+		[NIO_KEY(43)] = NIO_KEYMAP_CHAR('{'),
+		[NIO_KEY(33)] = NIO_KEYMAP_CHAR('}'),
+		[NIO_KEY(72)] = NIO_KEYMAP_CHAR('1'),
+		[NIO_KEY(62)] = NIO_KEYMAP_CHAR('2'),
+		[NIO_KEY(52)] = NIO_KEYMAP_CHAR(';'),
+		[NIO_KEY(42)] = NIO_KEYMAP_CHAR('['),
+		[NIO_KEY(32)] = NIO_KEYMAP_CHAR(']'),
+		[NIO_KEY(71)] = NIO_KEYMAP_CHAR('|'),
+		[NIO_KEY(61)] = NIO_KEYMAP_CHAR('='),
+		[NIO_KEY(51)] = NIO_KEYMAP_CHAR('?'),
+		[NIO_KEY(41)] = NIO_KEYMAP_CHAR('!'),
+		[NIO_KEY(31)] = NIO_KEYMAP_CHAR('\n')
+	},
+	/* SHIFT|CTRL */ {
+		[NIO_KEY(10)] = NIO_KEYMAP_CHAR(0),
+		[NIO_KEY(48)] = NIO_KEYMAP_CHAR(0),
+		[NIO_KEY(47)] = NIO_KEYMAP_CHAR(0),
+		[NIO_KEY(67)] = NIO_KEYMAP_CHAR('$'),
+		[NIO_KEY(57)] = NIO_KEYMAP_CHAR('#'),
+		[NIO_KEY(76)] = NIO_KEYMAP_CHAR('a'),
+		[NIO_KEY(66)] = NIO_KEYMAP_CHAR('b'),
+		[NIO_KEY(56)] = NIO_KEYMAP_CHAR('c'),
+		[NIO_KEY(46)] = NIO_KEYMAP_CHAR('d'),
+		[NIO_KEY(36)] = NIO_KEYMAP_CHAR('e'),
+		[NIO_KEY(26)] = NIO_KEYMAP_CHAR('f'),
+		[NIO_KEY(75)] = NIO_KEYMAP_CHAR('g'),
+		[NIO_KEY(65)] = NIO_KEYMAP_CHAR('h'),
+		[NIO_KEY(55)] = NIO_KEYMAP_CHAR('i'),
+		[NIO_KEY(45)] = NIO_KEYMAP_CHAR('j'),
+		[NIO_KEY(35)] = NIO_KEYMAP_CHAR('k'),
+		[NIO_KEY(25)] = NIO_KEYMAP_CHAR('l'),
+		[NIO_KEY(74)] = NIO_KEYMAP_CHAR('m'),
+		[NIO_KEY(64)] = NIO_KEYMAP_CHAR('n'),
+		[NIO_KEY(54)] = NIO_KEYMAP_CHAR('o'),
+		[NIO_KEY(44)] = NIO_KEYMAP_CHAR('\b'),
+		[NIO_KEY(73)] = NIO_KEYMAP_CHAR('p'),
+		[NIO_KEY(63)] = NIO_KEYMAP_CHAR('q'),
+		[NIO_KEY(53)] = NIO_KEYMAP_CHAR('r'),
+		[NIO_KEY(43)] = NIO_KEYMAP_CHAR('s'),
+		[NIO_KEY(33)] = NIO_KEYMAP_CHAR('t'),
+		[NIO_KEY(72)] = NIO_KEYMAP_CHAR('u'),
+		[NIO_KEY(62)] = NIO_KEYMAP_CHAR('v'),
+		[NIO_KEY(52)] = NIO_KEYMAP_CHAR('w'),
+		[NIO_KEY(42)] = NIO_KEYMAP_CHAR('x'),
+		[NIO_KEY(32)] = NIO_KEYMAP_CHAR('y'),
+		[NIO_KEY(71)] = NIO_KEYMAP_CHAR('z'),
+		[NIO_KEY(61)] = NIO_KEYMAP_CHAR(' '),
+		[NIO_KEY(51)] = NIO_KEYMAP_CHAR('"'),
+		[NIO_KEY(41)] = NIO_KEYMAP_CHAR(':'),
+		[NIO_KEY(31)] = NIO_KEYMAP_CHAR('\n')
+	},
+	/* OPTN */ {
+		[NIO_KEY(10)] = NIO_KEYMAP_CHAR(0),
+		[NIO_KEY(48)] = NIO_KEYMAP_CHAR(0),
+		[NIO_KEY(47)] = NIO_KEYMAP_CHAR(0),
+		[NIO_KEY(67)] = NIO_KEYMAP_CHAR('`'),
+		[NIO_KEY(57)] = NIO_KEYMAP_CHAR('^'),
+		[NIO_KEY(76)] = NIO_KEYMAP_CHAR('A'),
+		[NIO_KEY(66)] = NIO_KEYMAP_CHAR('B'),
+		[NIO_KEY(56)] = NIO_KEYMAP_CHAR('C'),
+		[NIO_KEY(46)] = NIO_KEYMAP_CHAR('D'),
+		[NIO_KEY(36)] = NIO_KEYMAP_CHAR('E'),
+		[NIO_KEY(26)] = NIO_KEYMAP_CHAR('F'),
+		[NIO_KEY(75)] = NIO_KEYMAP_CHAR('<'),
+		[NIO_KEY(65)] = NIO_KEYMAP_CHAR('>'),
+		[NIO_KEY(55)] = NIO_KEYMAP_CHAR('('),
+		[NIO_KEY(45)] = NIO_KEYMAP_CHAR(')'),
+		[NIO_KEY(35)] = NIO_KEYMAP_CHAR(','),
+		[NIO_KEY(25)] = NIO_KEYMAP_CHAR('\t'),
+		[NIO_KEY(74)] = NIO_KEYMAP_CHAR('7'),
+		[NIO_KEY(64)] = NIO_KEYMAP_CHAR('8'),
+		[NIO_KEY(54)] = NIO_KEYMAP_CHAR('9'),
+		[NIO_KEY(44)] = NIO_KEYMAP_CHAR('\b'),
+		[NIO_KEY(73)] = NIO_KEYMAP_CHAR('4'),
+		[NIO_KEY(63)] = NIO_KEYMAP_CHAR('5'),
+		[NIO_KEY(53)] = NIO_KEYMAP_CHAR('6'),
+		[NIO_KEY(43)] = NIO_KEYMAP_CHAR('*'),
+		[NIO_KEY(33)] = NIO_KEYMAP_CHAR('/'),
+		[NIO_KEY(72)] = NIO_KEYMAP_CHAR('1'),
+		[NIO_KEY(62)] = NIO_KEYMAP_CHAR('2'),
+		[NIO_KEY(52)] = NIO_KEYMAP_CHAR('3'),
+		[NIO_KEY(42)] = NIO_KEYMAP_CHAR('+'),
+		[NIO_KEY(32)] = NIO_KEYMAP_CHAR('-'),
+		[NIO_KEY(71)] = NIO_KEYMAP_CHAR('0'),
+		[NIO_KEY(61)] = NIO_KEYMAP_CHAR('.'),
+		[NIO_KEY(51)] = NIO_KEYMAP_CHAR('_'),
+		[NIO_KEY(41)] = NIO_KEYMAP_CHAR('~'),
+		[NIO_KEY(31)] = NIO_KEYMAP_CHAR('\n')
+	},
+	/* SHIFT|OPTN */ {
+		[NIO_KEY(10)] = NIO_KEYMAP_CHAR(0),
+		[NIO_KEY(48)] = NIO_KEYMAP_CHAR(0),
+		[NIO_KEY(47)] = NIO_KEYMAP_CHAR(0),
+		[NIO_KEY(67)] = NIO_KEYMAP_CHAR('$'),
+		[NIO_KEY(57)] = NIO_KEYMAP_CHAR('#'),
+		[NIO_KEY(76)] = NIO_KEYMAP_CHAR('A'),
+		[NIO_KEY(66)] = NIO_KEYMAP_CHAR('B'),
+		[NIO_KEY(56)] = NIO_KEYMAP_CHAR('C'),
+		[NIO_KEY(46)] = NIO_KEYMAP_CHAR('D'),
+		[NIO_KEY(36)] = NIO_KEYMAP_CHAR('E'),
+		[NIO_KEY(26)] = NIO_KEYMAP_CHAR('F'),
+		[NIO_KEY(75)] = NIO_KEYMAP_CHAR('G'),
+		[NIO_KEY(65)] = NIO_KEYMAP_CHAR('H'),
+		[NIO_KEY(55)] = NIO_KEYMAP_CHAR('I'),
+		[NIO_KEY(45)] = NIO_KEYMAP_CHAR('J'),
+		[NIO_KEY(35)] = NIO_KEYMAP_CHAR('K'),
+		[NIO_KEY(25)] = NIO_KEYMAP_CHAR('L'),
+		[NIO_KEY(74)] = NIO_KEYMAP_CHAR('M'),
+		[NIO_KEY(64)] = NIO_KEYMAP_CHAR('N'),
+		[NIO_KEY(54)] = NIO_KEYMAP_CHAR('O'),
+		[NIO_KEY(44)] = NIO_KEYMAP_CHAR('\b'),
+		[NIO_KEY(73)] = NIO_KEYMAP_CHAR('P'),
+		[NIO_KEY(63)] = NIO_KEYMAP_CHAR('Q'),
+		[NIO_KEY(53)] = NIO_KEYMAP_CHAR('R'),
+		[NIO_KEY(43)] = NIO_KEYMAP_CHAR('S'),
+		[NIO_KEY(33)] = NIO_KEYMAP_CHAR('T'),
+		[NIO_KEY(72)] = NIO_KEYMAP_CHAR('U'),
+		[NIO_KEY(62)] = NIO_KEYMAP_CHAR('V'),
+		[NIO_KEY(52)] = NIO_KEYMAP_CHAR('W'),
+		[NIO_KEY(42)] = NIO_KEYMAP_CHAR('X'),
+		[NIO_KEY(32)] = NIO_KEYMAP_CHAR('Y'),
+		[NIO_KEY(71)] = NIO_KEYMAP_CHAR('Z'),
+		[NIO_KEY(61)] = NIO_KEYMAP_CHAR(' '),
+		[NIO_KEY(51)] = NIO_KEYMAP_CHAR('"'),
+		[NIO_KEY(41)] = NIO_KEYMAP_CHAR(':'),
+		[NIO_KEY(31)] = NIO_KEYMAP_CHAR('\n')
+	},
+	/* CTRL|OPTN */ {
+		[NIO_KEY(10)] = NIO_KEYMAP_CHAR(0),
+		[NIO_KEY(48)] = NIO_KEYMAP_CHAR(0),
+		[NIO_KEY(47)] = NIO_KEYMAP_CHAR(0),
+		[NIO_KEY(67)] = NIO_KEYMAP_CHAR('`'),
+		[NIO_KEY(57)] = NIO_KEYMAP_CHAR('^'),
+		[NIO_KEY(76)] = NIO_KEYMAP_CHAR('A'),
+		[NIO_KEY(66)] = NIO_KEYMAP_CHAR('B'),
+		[NIO_KEY(56)] = NIO_KEYMAP_CHAR('C'),
+		[NIO_KEY(46)] = NIO_KEYMAP_CHAR('D'),
+		[NIO_KEY(36)] = NIO_KEYMAP_CHAR('E'),
+		[NIO_KEY(26)] = NIO_KEYMAP_CHAR('F'),
+		[NIO_KEY(75)] = NIO_KEYMAP_CHAR('<'),
+		[NIO_KEY(65)] = NIO_KEYMAP_CHAR('>'),
+		[NIO_KEY(55)] = NIO_KEYMAP_CHAR('('),
+		[NIO_KEY(45)] = NIO_KEYMAP_CHAR(')'),
+		[NIO_KEY(35)] = NIO_KEYMAP_CHAR(','),
+		[NIO_KEY(25)] = NIO_KEYMAP_CHAR('\t'),
+		[NIO_KEY(74)] = NIO_KEYMAP_CHAR('7'),
+		[NIO_KEY(64)] = NIO_KEYMAP_CHAR('8'),
+		[NIO_KEY(54)] = NIO_KEYMAP_CHAR('9'),
+		[NIO_KEY(44)] = NIO_KEYMAP_CHAR('\b'),
+		[NIO_KEY(73)] = NIO_KEYMAP_CHAR('4'),
+		[NIO_KEY(63)] = NIO_KEYMAP_CHAR('5'),
+		[NIO_KEY(53)] = NIO_KEYMAP_CHAR('6'),
+		[NIO_KEY(43)] = NIO_KEYMAP_CHAR('{'),
+		[NIO_KEY(33)] = NIO_KEYMAP_CHAR('}'),
+		[NIO_KEY(72)] = NIO_KEYMAP_CHAR('1'),
+		[NIO_KEY(62)] = NIO_KEYMAP_CHAR('2'),
+		[NIO_KEY(52)] = NIO_KEYMAP_CHAR(';'),
+		[NIO_KEY(42)] = NIO_KEYMAP_CHAR('['),
+		[NIO_KEY(32)] = NIO_KEYMAP_CHAR(']'),
+		[NIO_KEY(71)] = NIO_KEYMAP_CHAR('|'),
+		[NIO_KEY(61)] = NIO_KEYMAP_CHAR('='),
+		[NIO_KEY(51)] = NIO_KEYMAP_CHAR('?'),
+		[NIO_KEY(41)] = NIO_KEYMAP_CHAR('!'),
+		[NIO_KEY(31)] = NIO_KEYMAP_CHAR('\n')
+	},
+	/* SHIFT|CTRL|OPTN */ {
+		[NIO_KEY(10)] = NIO_KEYMAP_CHAR(0),
+		[NIO_KEY(48)] = NIO_KEYMAP_CHAR(0),
+		[NIO_KEY(47)] = NIO_KEYMAP_CHAR(0),
+		[NIO_KEY(67)] = NIO_KEYMAP_CHAR('$'),
+		[NIO_KEY(57)] = NIO_KEYMAP_CHAR('#'),
+		[NIO_KEY(76)] = NIO_KEYMAP_CHAR('A'),
+		[NIO_KEY(66)] = NIO_KEYMAP_CHAR('B'),
+		[NIO_KEY(56)] = NIO_KEYMAP_CHAR('C'),
+		[NIO_KEY(46)] = NIO_KEYMAP_CHAR('D'),
+		[NIO_KEY(36)] = NIO_KEYMAP_CHAR('E'),
+		[NIO_KEY(26)] = NIO_KEYMAP_CHAR('F'),
+		[NIO_KEY(75)] = NIO_KEYMAP_CHAR('G'),
+		[NIO_KEY(65)] = NIO_KEYMAP_CHAR('H'),
+		[NIO_KEY(55)] = NIO_KEYMAP_CHAR('I'),
+		[NIO_KEY(45)] = NIO_KEYMAP_CHAR('J'),
+		[NIO_KEY(35)] = NIO_KEYMAP_CHAR('K'),
+		[NIO_KEY(25)] = NIO_KEYMAP_CHAR('L'),
+		[NIO_KEY(74)] = NIO_KEYMAP_CHAR('M'),
+		[NIO_KEY(64)] = NIO_KEYMAP_CHAR('N'),
+		[NIO_KEY(54)] = NIO_KEYMAP_CHAR('O'),
+		[NIO_KEY(44)] = NIO_KEYMAP_CHAR('\b'),
+		[NIO_KEY(73)] = NIO_KEYMAP_CHAR('P'),
+		[NIO_KEY(63)] = NIO_KEYMAP_CHAR('Q'),
+		[NIO_KEY(53)] = NIO_KEYMAP_CHAR('R'),
+		[NIO_KEY(43)] = NIO_KEYMAP_CHAR('S'),
+		[NIO_KEY(33)] = NIO_KEYMAP_CHAR('T'),
+		[NIO_KEY(72)] = NIO_KEYMAP_CHAR('U'),
+		[NIO_KEY(62)] = NIO_KEYMAP_CHAR('V'),
+		[NIO_KEY(52)] = NIO_KEYMAP_CHAR('W'),
+		[NIO_KEY(42)] = NIO_KEYMAP_CHAR('X'),
+		[NIO_KEY(32)] = NIO_KEYMAP_CHAR('Y'),
+		[NIO_KEY(71)] = NIO_KEYMAP_CHAR('Z'),
+		[NIO_KEY(61)] = NIO_KEYMAP_CHAR(' '),
+		[NIO_KEY(51)] = NIO_KEYMAP_CHAR('"'),
+		[NIO_KEY(41)] = NIO_KEYMAP_CHAR(':'),
+		[NIO_KEY(31)] = NIO_KEYMAP_CHAR('\n')
+	}
+}};
+#endif
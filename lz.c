@@ -0,0 +1,206 @@
+/**
+ * @file lz.c
+ * @author  Julien "Juju" Savard <juju2143@gmail.com>
+ * @author  Julian Mackeben aka compu <compujuckel@googlemail.com>
+ * @version 0.1
+ *
+ * @section LICENSE
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301  USA
+ *
+ * @section DESCRIPTION
+ *
+ * LZ compression
+ */
+#include <stdlib.h>
+#include <string.h>
+#include "prizmio.h"
+
+/* The stream is a sequence of groups: a flag byte, then up to 8 tokens,
+ * one per bit of the flag byte starting with the lowest. A set bit is a
+ * literal byte. A clear bit is a match of two bytes
+ *   distance-1 (low 8 bits), distance-1 (high 4 bits) << 4 | length code
+ * where a length code below 15 is a length of code+3, and 15 is followed
+ * by a byte holding length-18. Matches may overlap the bytes they make,
+ * which is how runs are stored.
+ */
+#define LZ_MIN 3
+#define LZ_MAX (18+255)
+#define LZ_HASH_BITS 12
+#define LZ_EMPTY ((unsigned)-1)
+
+static inline unsigned lz_hash(const unsigned char* p)
+{
+	return ((p[0] << 16 | p[1] << 8 | p[2])*2654435761u) >> (32-LZ_HASH_BITS);
+}
+
+size_t nio_lz_compress(const void* src, size_t size, void* dst, size_t dst_size)
+{
+	const unsigned char* in = src;
+	unsigned char* out = dst;
+	unsigned char* end = out+dst_size;
+	unsigned char* flags = NULL;
+	int bit = 8;
+	size_t pos = 0;
+	// Last position of each hash, only one candidate is tried per position
+	unsigned* head = malloc(sizeof(unsigned) << LZ_HASH_BITS);
+	if(head == NULL)
+		return 0;
+	memset(head, 0xFF, sizeof(unsigned) << LZ_HASH_BITS);
+
+	while(pos < size)
+	{
+		size_t len = 0, dist = 0;
+		if(bit == 8)
+		{
+			if(out == end)
+				break;
+			flags = out++;
+			*flags = 0;
+			bit = 0;
+		}
+		if(pos+LZ_MIN <= size)
+		{
+			unsigned h = lz_hash(in+pos);
+			unsigned candidate = head[h];
+			head[h] = pos;
+			if(candidate != LZ_EMPTY && pos-candidate <= NIO_LZ_WINDOW)
+			{
+				size_t max = size-pos < LZ_MAX ? size-pos : LZ_MAX;
+				while(len < max && in[candidate+len] == in[pos+len])
+					len++;
+				dist = pos-candidate;
+			}
+		}
+		if(len >= LZ_MIN)
+		{
+			size_t i;
+			if(end-out < (len >= 18 ? 3 : 2))
+				break;
+			*out++ = (dist-1) & 0xFF;
+			*out++ = (((dist-1) >> 4) & 0xF0) | (len >= 18 ? 15 : len-3);
+			if(len >= 18)
+				*out++ = len-18;
+			for(i = 1; i < len && pos+i+LZ_MIN <= size; i++)
+				head[lz_hash(in+pos+i)] = pos+i;
+			pos += len;
+		}
+		else
+		{
+			if(out == end)
+				break;
+			*flags |= 1 << bit;
+			*out++ = in[pos++];
+		}
+		bit++;
+	}
+	free(head);
+	// 0 tells the caller the output did not fit
+	return pos < size ? 0 : (size_t)(out-(unsigned char*)dst);
+}
+
+struct lz_decoder
+{
+	nio_source source;
+	void* source_ctx;
+	nio_sink sink;
+	void* sink_ctx;
+	int in_pos;
+	int in_len;
+	unsigned pos;
+	unsigned char in[64];
+	unsigned char window[NIO_LZ_WINDOW];
+};
+
+static int lz_getc(struct lz_decoder* d)
+{
+	if(d->in_pos == d->in_len)
+	{
+		d->in_len = d->source(d->source_ctx, (char*)d->in, sizeof(d->in));
+		d->in_pos = 0;
+		if(d->in_len <= 0)
+		{
+			d->in_len = 0;
+			return -1;
+		}
+	}
+	return d->in[d->in_pos++];
+}
+
+// The window is handed to the sink each time it is full.
+static inline void lz_putc(struct lz_decoder* d, unsigned char b)
+{
+	d->window[d->pos++] = b;
+	if(d->pos == NIO_LZ_WINDOW)
+	{
+		d->sink(d->sink_ctx, (const char*)d->window, NIO_LZ_WINDOW);
+		d->pos = 0;
+	}
+}
+
+int nio_lz_decompress(nio_source source, void* source_ctx, nio_sink sink, void* sink_ctx, size_t length)
+{
+	struct lz_decoder d;
+	size_t done = 0;
+	int flags = 0, bit = 8;
+	d.source = source;
+	d.source_ctx = source_ctx;
+	d.sink = sink;
+	d.sink_ctx = sink_ctx;
+	d.in_pos = d.in_len = 0;
+	d.pos = 0;
+
+	while(done < length)
+	{
+		int a, b;
+		if(bit == 8)
+		{
+			if((flags = lz_getc(&d)) < 0)
+				return -1;
+			bit = 0;
+		}
+		if((a = lz_getc(&d)) < 0)
+			return -1;
+		if(flags & (1 << bit++))
+		{
+			lz_putc(&d, a);
+			done++;
+			continue;
+		}
+		if((b = lz_getc(&d)) < 0)
+			return -1;
+		{
+			unsigned dist = (a | (b & 0xF0) << 4)+1;
+			size_t len = (b & 0x0F)+LZ_MIN;
+			if(len == 18)
+			{
+				int extra = lz_getc(&d);
+				if(extra < 0)
+					return -1;
+				len += extra;
+			}
+			if(dist > done || len > length-done)
+				return -1;
+			done += len;
+			// Read before write, a distance of a whole window is the byte being replaced
+			while(len-- > 0)
+				lz_putc(&d, d.window[(d.pos-dist) & (NIO_LZ_WINDOW-1)]);
+		}
+	}
+	if(d.pos > 0)
+		sink(sink_ctx, (const char*)d.window, d.pos);
+	return 0;
+}
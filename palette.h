@@ -0,0 +1,67 @@
+/**
+ * @file palette.h
+ * @author  Julien "Juju" Savard <juju2143@gmail.com>
+ * @version 0.1
+ *
+ * @section LICENSE
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301  USA
+ *
+ * @section DESCRIPTION
+ *
+ * This file contains the default 256-color palette in RGB565.
+ * Colors 0-15 are the standard ANSI colors, 16-231 a 6x6x6 color cube
+ * and 232-255 a grayscale ramp, like xterm-256color.
+ */
+
+#ifndef PALETTE_H
+#define PALETTE_H
+
+const unsigned short nio_default_palette[256] = {
+/*000*/ 0x0000, 0xa800, 0x0540, 0xaaa0, 0x0015, 0xa815, 0x0555, 0xad55,
+/*008*/ 0x5aab, 0xfaab, 0x5feb, 0xffeb, 0x5abf, 0xfabf, 0x5fff, 0xffff,
+/*016*/ 0x0000, 0x0006, 0x000c, 0x0012, 0x0018, 0x001f, 0x0180, 0x0186,
+/*024*/ 0x018c, 0x0192, 0x0198, 0x019f, 0x0320, 0x0326, 0x032c, 0x0332,
+/*032*/ 0x0338, 0x033f, 0x04a0, 0x04a6, 0x04ac, 0x04b2, 0x04b8, 0x04bf,
+/*040*/ 0x0640, 0x0646, 0x064c, 0x0652, 0x0658, 0x065f, 0x07e0, 0x07e6,
+/*048*/ 0x07ec, 0x07f2, 0x07f8, 0x07ff, 0x3000, 0x3006, 0x300c, 0x3012,
+/*056*/ 0x3018, 0x301f, 0x3180, 0x3186, 0x318c, 0x3192, 0x3198, 0x319f,
+/*064*/ 0x3320, 0x3326, 0x332c, 0x3332, 0x3338, 0x333f, 0x34a0, 0x34a6,
+/*072*/ 0x34ac, 0x34b2, 0x34b8, 0x34bf, 0x3640, 0x3646, 0x364c, 0x3652,
+/*080*/ 0x3658, 0x365f, 0x37e0, 0x37e6, 0x37ec, 0x37f2, 0x37f8, 0x37ff,
+/*088*/ 0x6000, 0x6006, 0x600c, 0x6012, 0x6018, 0x601f, 0x6180, 0x6186,
+/*096*/ 0x618c, 0x6192, 0x6198, 0x619f, 0x6320, 0x6326, 0x632c, 0x6332,
+/*104*/ 0x6338, 0x633f, 0x64a0, 0x64a6, 0x64ac, 0x64b2, 0x64b8, 0x64bf,
+/*112*/ 0x6640, 0x6646, 0x664c, 0x6652, 0x6658, 0x665f, 0x67e0, 0x67e6,
+/*120*/ 0x67ec, 0x67f2, 0x67f8, 0x67ff, 0x9000, 0x9006, 0x900c, 0x9012,
+/*128*/ 0x9018, 0x901f, 0x9180, 0x9186, 0x918c, 0x9192, 0x9198, 0x919f,
+/*136*/ 0x9320, 0x9326, 0x932c, 0x9332, 0x9338, 0x933f, 0x94a0, 0x94a6,
+/*144*/ 0x94ac, 0x94b2, 0x94b8, 0x94bf, 0x9640, 0x9646, 0x964c, 0x9652,
+/*152*/ 0x9658, 0x965f, 0x97e0, 0x97e6, 0x97ec, 0x97f2, 0x97f8, 0x97ff,
+/*160*/ 0xc000, 0xc006, 0xc00c, 0xc012, 0xc018, 0xc01f, 0xc180, 0xc186,
+/*168*/ 0xc18c, 0xc192, 0xc198, 0xc19f, 0xc320, 0xc326, 0xc32c, 0xc332,
+/*176*/ 0xc338, 0xc33f, 0xc4a0, 0xc4a6, 0xc4ac, 0xc4b2, 0xc4b8, 0xc4bf,
+/*184*/ 0xc640, 0xc646, 0xc64c, 0xc652, 0xc658, 0xc65f, 0xc7e0, 0xc7e6,
+/*192*/ 0xc7ec, 0xc7f2, 0xc7f8, 0xc7ff, 0xf800, 0xf806, 0xf80c, 0xf812,
+/*200*/ 0xf818, 0xf81f, 0xf980, 0xf986, 0xf98c, 0xf992, 0xf998, 0xf99f,
+/*208*/ 0xfb20, 0xfb26, 0xfb2c, 0xfb32, 0xfb38, 0xfb3f, 0xfca0, 0xfca6,
+/*216*/ 0xfcac, 0xfcb2, 0xfcb8, 0xfcbf, 0xfe40, 0xfe46, 0xfe4c, 0xfe52,
+/*224*/ 0xfe58, 0xfe5f, 0xffe0, 0xffe6, 0xffec, 0xfff2, 0xfff8, 0xffff,
+/*232*/ 0x0841, 0x1082, 0x18c3, 0x2104, 0x2945, 0x3186, 0x39c7, 0x4208,
+/*240*/ 0x4a49, 0x528a, 0x5acb, 0x630c, 0x6b4d, 0x738e, 0x7bcf, 0x8410,
+/*248*/ 0x8c51, 0x9492, 0x9cd3, 0xa514, 0xad55, 0xb596, 0xbdd7, 0xc618
+};
+#endif
@@ -26,6 +26,8 @@
  * Prizm I/O 3.0 header file, based on Nspire I/O 3.0
  */
 #include <stdlib.h>
+#include <stdarg.h>
+#include <stdio.h>
 
 #ifndef PRIZMIO_H
 #define PRIZMIO_H
@@ -60,11 +62,52 @@ typedef enum {
 	NIO_COLOR_WHITE
 } nio_colour;
 
+/** Scrollback history of a console, see nio_scrollback_enable(). */
+struct nio_scrollback
+{
+	unsigned char* buffer;
+	size_t size;
+	size_t head;
+	size_t used;
+	int lines;
+	int view_offset;
+	char* view_data;
+	unsigned short* view_color;
+};
+typedef struct nio_scrollback nio_scrollback;
+
+/** Performance counters of a console or of the screen layer, see nio_stats_get().
+	They are only counted when the library is built with NIO_STATS defined.
+*/
+struct nio_stats
+{
+	/** Chars drawn */
+	unsigned long glyphs;
+	/** Pixels written to the VRAM, including moved ones */
+	unsigned long pixels;
+	/** Pixels written by the functions that present on their own, like nio_pixel_set() */
+	unsigned long dd_pixels;
+	/** Presents of the whole screen */
+	unsigned long presents_full;
+	/** Presents of a stripe of rows */
+	unsigned long presents_partial;
+	/** Calls to nio_scroll() */
+	unsigned long scrolls;
+	/** Calls to nio_fflush(), also made by the drawing functions */
+	unsigned long flushes;
+	/** Bytes produced by the printf-like functions */
+	unsigned long formatted;
+	/** Reads of the keyboard */
+	unsigned long kbd_polls;
+};
+typedef struct nio_stats nio_stats;
+
 /** Console structure. */
 struct nio_console
 {
 	char* data;
 	unsigned short* color;
+	int head;
 	int cursor_x;
 	int cursor_y;
 	int max_x;
@@ -73,6 +116,9 @@ struct nio_console
 	int offset_y;
 	unsigned char default_background_color;
 	unsigned char default_foreground_color;
+	const unsigned short* palette;
+	unsigned char* dirty;
+	nio_scrollback* scrollback;
 	BOOL drawing_enabled;
 	BOOL cursor_enabled;
 	int cursor_type;
@@ -82,20 +128,133 @@ struct nio_console
 	BOOL cursor_blink_status;
 	unsigned cursor_blink_timestamp;
 	unsigned cursor_blink_duration;
+	BOOL cursor_drawn;
+	int cursor_drawn_x;
+	int cursor_drawn_y;
+	nio_stats stats;
+	/** Compositor drawing the console, see nio_compositor_add() */
+	struct nio_compositor* compositor;
 };
 typedef struct nio_console nio_console;
 
+#ifdef NIO_STATS
+/** Counters of the screen layer. For internal use. */
+extern nio_stats nio_stats_screen;
+/** Adds to a counter of the screen layer. For internal use. */
+#define NIO_STAT(field, n) (nio_stats_screen.field += (n))
+/** Adds to a counter of a console. For internal use. */
+#define NIO_CSL_STAT(c, field, n) ((c)->stats.field += (n))
+#else
+#define NIO_STAT(field, n) ((void)0)
+#define NIO_CSL_STAT(c, field, n) ((void)0)
+#endif
+
 #define NIO_CURSOR_BLOCK 0
 #define NIO_CURSOR_UNDERSCORE 1
 #define NIO_CURSOR_VERTICAL 2
 #define NIO_CURSOR_CUSTOM 3
 
+#define NIO_PRESENT_IMMEDIATE 0
+#define NIO_PRESENT_END_OF_CALL 1
+#define NIO_PRESENT_EXPLICIT 2
+
 #define NIO_CHAR_WIDTH 6
 #define NIO_CHAR_HEIGHT 8
 
+/** Bytes per row of the dirty-cell bitmap of a console. */
+#define NIO_DIRTY_STRIDE(c) (((c)->max_x+7)>>3)
+
 #define NIO_MAX_ROWS 27
 #define NIO_MAX_COLS 64
 
+/** Position of a key in the keyboard matrix, from its basic keycode (as used by isKeyPressed()). */
+#define NIO_KEY(basic_keycode) (((basic_keycode)%10)*8+(basic_keycode)/10-1)
+
+/** Number of key positions in a keymap. */
+#define NIO_KEYMAP_KEYS 80
+
+/** Modifier bits, used to index the layers of a keymap. SHIFT is set by ALPHA or caps lock,
+	CTRL by the SHIFT key and OPTN by the OPTN key.
+*/
+#define NIO_KEYMAP_SHIFT 1
+#define NIO_KEYMAP_CTRL  2
+#define NIO_KEYMAP_OPTN  4
+#define NIO_KEYMAP_LAYERS 8
+
+/** Entry of a keymap typing the char c. Entries left at 0 type nothing. */
+#define NIO_KEYMAP_CHAR(c) (0x100 | (unsigned char)(c))
+
+/** Keymap used by nio_getch(): the entry of each key position for each set of modifiers. */
+struct nio_keymap
+{
+	unsigned short keys[NIO_KEYMAP_LAYERS][NIO_KEYMAP_KEYS];
+};
+typedef struct nio_keymap nio_keymap;
+
+/** Default keymap. */
+extern const nio_keymap nio_default_keymap;
+
+/** Default 256-color RGB565 palette used by consoles and the nio_pixel_* functions. */
+extern const unsigned short nio_default_palette[256];
+
+/** Size of the keyboard event queue. */
+#ifndef NIO_KBD_QUEUE
+#define NIO_KBD_QUEUE 32
+#endif
+
+/** Types of keyboard events. */
+#define NIO_KBD_PRESS   1
+#define NIO_KBD_RELEASE 2
+#define NIO_KBD_REPEAT  3
+
+/** Keyboard event. */
+struct nio_kbd_event
+{
+	/** NIO_KBD_PRESS, NIO_KBD_RELEASE or NIO_KBD_REPEAT */
+	unsigned char type;
+	/** Position of the key in the matrix, see NIO_KEY() */
+	unsigned char key;
+	/** Time of the event in ms, from the RTC */
+	unsigned time;
+};
+typedef struct nio_kbd_event nio_kbd_event;
+
+/** Reads the keyboard and queues the events since the last read. This is done by
+	nio_kbd_poll() and nio_kbd_wait(), call it directly to not miss quick presses
+	when they are not called often. For internal use.
+*/
+void nio_kbd_scan(void);
+
+/** Gets the next keyboard event without waiting.
+	@param e Receives the event
+	@return TRUE if there was an event
+*/
+BOOL nio_kbd_poll(nio_kbd_event* e);
+
+/** Waits for the next keyboard event.
+	@param e Receives the event
+	@param timeout Longest wait in ms, -1 to wait forever
+	@return TRUE if there was an event, FALSE on timeout
+*/
+BOOL nio_kbd_wait(nio_kbd_event* e, const int timeout);
+
+/** Sets the typematic repeat: the last key pressed makes NIO_KBD_REPEAT events while it is held.
+	A program that polls late gets one repeat, not the ones it missed. When the queue is full,
+	presses and releases take the place of the oldest repeat.
+	@param delay Time before the first repeat in ms, 0 to disable repeat. The default is 500.
+	@param period Time between repeats in ms. The default is 100.
+*/
+void nio_kbd_repeat(const int delay, const int period);
+
+/** Drops the queued events. Keys that are down do not make a press event. */
+void nio_kbd_clear(void);
+
+/** Checks if a key is down, as of the last read of the keyboard.
+	@param key Position of the key in the matrix, see NIO_KEY()
+	@return TRUE if it is down
+*/
+BOOL nio_kbd_down(const int key);
+
 void keyupdate(void);
 int keydownlast(int basic_keycode);
 int keydownhold(int basic_keycode);
@@ -123,17 +282,171 @@ void nio_grid_puts(const int offset_x, const int offset_y, const int x, const in
 */
 void nio_grid_putc(const int offset_x, const int offset_y, const int x, const int y, const char ch, const unsigned char bgColor, const unsigned char textColor);
 
-/** Loads a console from a file on flash storage.
+/** Returns the RGB565 value of a color of the default palette.
+	@param color Color (0-255)
+	@return RGB565 color, 0 if out of range
+*/
+unsigned short getPaletteColor(unsigned int color);
+
+/** Sets when drawing functions push the VRAM to the screen.
+	All drawing is done in the VRAM, and the rows that changed are pushed with one
+	Bdisp_PutDisp_DD_stripe() per present.
+	@param policy One of:
+	- NIO_PRESENT_IMMEDIATE: after every char or pixel drawn by a non-VRAM function
+	- NIO_PRESENT_END_OF_CALL: when the outermost library call returns (default)
+	- NIO_PRESENT_EXPLICIT: only when nio_present() is called
+*/
+void nio_present_policy(const int policy);
+
+/** Gets the present policy set with nio_present_policy().
+	@return Present policy
+*/
+int nio_present_get_policy(void);
+
+/** Pushes the rows of the VRAM that changed since the last present to the screen. */
+void nio_present(void);
+
+/** Marks rows of the VRAM as changed so the next present pushes them. For internal use.
+	@param y1 First row in px
+	@param y2 Last row in px
+*/
+void nio_vram_touch(int y1, int y2);
+
+/** Holds back presents until the matching nio_present_release(). Calls can be nested. For internal use. */
+void nio_present_hold(void);
+
+/** Ends a nio_present_hold() and presents according to the present policy. For internal use. */
+void nio_present_release(void);
+
+/** Gets the performance counters of a console or of the screen layer.
+	The counters of a console only count what was done for it: its glyphs, the pixels
+	of its glyphs and scrolls, its scrolls, flushes and formatted bytes. The screen layer
+	counts everything, including the presents and keyboard reads.
+	\note All counters stay at 0 unless the library is built with NIO_STATS defined.
+	@param c Console, NULL for the screen layer
+	@param s Receives the counters
+*/
+void nio_stats_get(const nio_console* c, nio_stats* s);
+
+/** Sets the performance counters of a console or of the screen layer back to 0.
+	@param c Console, NULL for the screen layer
+*/
+void nio_stats_reset(nio_console* c);
+
+/** Sets a pixel on the screen and in the VRAM.
+	@param x x position in px
+	@param y y position in px
+	@param color Color (0-255)
+*/
+void nio_pixel_set(int x, int y, unsigned int color);
+
+/** Sets a pixel in the VRAM.
+	@param x x position in px
+	@param y y position in px
+	@param color Color (0-255)
+*/
+void nio_vram_pixel_set(int x, int y, unsigned int color);
+
+/** Sets a pixel in the VRAM to a RGB565 color and presents it according to the present policy. For internal use.
+	@param x x position in px
+	@param y y position in px
+	@param color RGB565 color
+*/
+void nio_rgb_pixel_set(int x, int y, unsigned short color);
+
+/** Sets a pixel in the VRAM to a RGB565 color. For internal use.
+	@param x x position in px
+	@param y y position in px
+	@param color RGB565 color
+*/
+void nio_vram_rgb_pixel_set(int x, int y, unsigned short color);
+
+/** Moves a rectangle of the VRAM up. The rectangle must be inside the screen. For internal use.
+	@param x x position in px
+	@param y y position in px
+	@param w width in px
+	@param h height in px
+	@param dy Number of pixel rows to move up by. The bottom dy rows keep their old content.
+*/
+void nio_vram_move_up(int x, int y, int w, int h, int dy);
+
+/** Fills a rectangle of the VRAM with a RGB565 color. It is clipped to the screen.
+	@param x x position in px
+	@param y y position in px
+	@param w width in px
+	@param h height in px
+	@param color RGB565 color
+*/
+void nio_vram_fill(int x, int y, int w, int h, unsigned short color);
+
+/** Draws a char to the VRAM with RGB565 colors and presents it according to the present policy. For internal use.
+	@param x x position in px
+	@param y y position in px
+	@param ch Char
+	@param bg Background RGB565 color
+	@param fg Text RGB565 color
+*/
+void nio_glyph_putc(int x, int y, char ch, unsigned short bg, unsigned short fg);
+
+/** Draws a char to the VRAM with RGB565 colors. The glyph is clipped once and written row by row. For internal use.
+	@param x x position in px
+	@param y y position in px
+	@param ch Char
+	@param bg Background RGB565 color
+	@param fg Text RGB565 color
+*/
+void nio_vram_glyph_putc(int x, int y, char ch, unsigned short bg, unsigned short fg);
+
+/** Draws a char to the screen and the VRAM.
+	@param x x position in px
+	@param y y position in px
+	@param ch Char
+	@param bgColor Background color
+	@param textColor Text color
+*/
+void nio_pixel_putc(int x, int y, char ch, int bgColor, int textColor);
+
+/** Draws a string to the screen and the VRAM.
+	@param x x position in px
+	@param y y position in px
+	@param str String
+	@param bgColor Background color
+	@param textColor Text color
+*/
+void nio_pixel_puts(int x, int y, const char* str, int bgColor, int textColor);
+
+/** Draws a char to the VRAM.
+	@param x x position in px
+	@param y y position in px
+	@param ch Char
+	@param bgColor Background color
+	@param textColor Text color
+*/
+void nio_vram_pixel_putc(int x, int y, char ch, int bgColor, int textColor);
+
+/** Draws a string to the VRAM.
+	@param x x position in px
+	@param y y position in px
+	@param str String
+	@param bgColor Background color
+	@param textColor Text color
+*/
+void nio_vram_pixel_puts(int x, int y, const char* str, int bgColor, int textColor);
+
+/** Loads a console from a file on flash storage. The console must not be initialized.
+	The file is checked and the console is left untouched if it is invalid.
     @param path File path
 	@param c Console
+	@return 0 on success, -1 on failure
 */
-void nio_load(const char* path, nio_console* c);
+int nio_load(const char* path, nio_console* c);
 
-/** Saves a console to a file in flash storage.
+/** Saves a console to a file in flash storage. The cells are run-length encoded when that makes the file smaller.
 	@param path File path
 	@param c Console
+	@return 0 on success, -1 on failure
 */
-void nio_save(const char* path, const nio_console* c);
+int nio_save(const char* path, const nio_console* c);
 
 /** Sets a default console that will be used for all functions without console argument, e.g. nio_puts()
 	@param c Console
@@ -145,11 +458,133 @@ void nio_set_default(nio_console* c);
 */
 void nio_clear(nio_console* c);
 
+/** Marks every cell of a console for redraw on the next nio_fflush().
+	Use this if something else has drawn over the console.
+	@param c Console
+*/
+void nio_invalidate(nio_console* c);
+
+/** Marks the cells of a console under a rectangle of the screen for redraw on the next nio_fflush().
+	@param c Console
+	@param x x position in px
+	@param y y position in px
+	@param w width in px
+	@param h height in px
+*/
+void nio_invalidate_rect(nio_console* c, const int x, const int y, const int w, const int h);
+
 /** Scrolls a console one line down.
 	@param c Console
 */
 void nio_scroll(nio_console* c);
 
+/** Enables the scrollback history of a console. Lines scrolled off the console are
+	kept in a compressed form until the budget is used up, then the oldest lines are dropped.
+	@param c Console
+	@param budget Memory for the history in bytes
+	@return 0 on success, -1 on failure or if the console is wider than 255 columns
+*/
+int nio_scrollback_enable(nio_console* c, size_t budget);
+
+/** Disables the scrollback history of a console and frees it.
+	@param c Console
+*/
+void nio_scrollback_disable(nio_console* c);
+
+/** Adds a line to the scrollback history of a console. For internal use.
+	@param c Console
+	@param data Chars of the line
+	@param color Colors of the line
+*/
+void nio_scrollback_push(nio_console* c, const char* data, const unsigned short* color);
+
+/** Scrolls a console back into its history. Only the visible rows are decoded and redrawn.
+	Writing to the console brings it back to offset 0.
+	@param c Console
+	@param offset Number of lines to scroll back, 0 shows the console as usual
+*/
+void nio_scrollback_view(nio_console* c, int offset);
+
+/** Scrolls a console back (positive) or forward (negative) from the current view.
+	Use c->max_y lines to page.
+	@param c Console
+	@param lines Number of lines
+*/
+void nio_scrollback_scroll(nio_console* c, int lines);
+
+/** Returns the number of lines in the scrollback history of a console.
+	@param c Console
+	@return Number of lines
+*/
+int nio_scrollback_lines(const nio_console* c);
+
+/** Number of consoles a compositor can hold. */
+#ifndef NIO_COMPOSITOR_MAX
+#define NIO_COMPOSITOR_MAX 8
+#endif
+
+/** Compositor: draws overlapping consoles in z-order, see nio_compositor_frame(). */
+struct nio_compositor
+{
+	/** Consoles from the bottom to the top */
+	nio_console* consoles[NIO_COMPOSITOR_MAX];
+	BOOL visible[NIO_COMPOSITOR_MAX];
+	/** drawing_enabled of the consoles before they were added */
+	BOOL drawing[NIO_COMPOSITOR_MAX];
+	int count;
+	/** RGB565 color of the screen where no console is shown */
+	unsigned short background;
+};
+typedef struct nio_compositor nio_compositor;
+
+/** Initializes a compositor with no consoles.
+	@param comp Compositor
+	@param background_color Color of the screen where no console is shown (0-255)
+*/
+void nio_compositor_init(nio_compositor* comp, const unsigned char background_color);
+
+/** Adds a console on top of the others, visible. The compositor draws it from now on: its
+	drawing is disabled, and writing to it only shows on the next nio_compositor_frame().
+	@param comp Compositor
+	@param c Console, in no other compositor
+	@return 0 on success, -1 if the compositor is full
+*/
+int nio_compositor_add(nio_compositor* comp, nio_console* c);
+
+/** Removes a console from a compositor and gives it back its drawing setting. What was under
+	it is drawn on the next nio_compositor_frame(). Do this before nio_free().
+	@param comp Compositor
+	@param c Console
+*/
+void nio_compositor_remove(nio_compositor* comp, nio_console* c);
+
+/** Shows or hides a console of a compositor.
+	@param comp Compositor
+	@param c Console
+	@param visible TRUE to show it
+*/
+void nio_compositor_show(nio_compositor* comp, nio_console* c, const BOOL visible);
+
+/** Moves a console of a compositor above all the others.
+	@param comp Compositor
+	@param c Console
+*/
+void nio_compositor_raise(nio_compositor* comp, nio_console* c);
+
+/** Moves a console of a compositor below all the others.
+	@param comp Compositor
+	@param c Console
+*/
+void nio_compositor_lower(nio_compositor* comp, nio_console* c);
+
+/** Draws what changed in the consoles of a compositor, then pushes all of it to the screen
+	with a single present (see nio_present_policy()). Cells fully hidden by a console higher
+	up are not drawn.
+	@param comp Compositor
+	@return Number of cells drawn
+*/
+int nio_compositor_frame(nio_compositor* comp);
+
 /** Draws a char from the console to the screen. For internal use.
     @param c Console
     @param pos_x x position
@@ -172,6 +607,24 @@ void nio_vram_csl_drawchar(nio_console* c, const int pos_x, const int pos_y);
 */
 void nio_csl_savechar(nio_console* c, const char ch, const int pos_x, const int pos_y);
 
+/** Writes chars to a console without drawing them. Control chars are handled like nio_fputc() does,
+	and the written cells are drawn on the next nio_fflush(). For internal use.
+	@param c Console
+	@param str Chars
+	@param len Number of chars
+*/
+void nio_csl_write(nio_console* c, const char* str, const int len);
+
+/** Sets the keymap used by nio_getch().
+	@param keymap Keymap, or NULL for the default one. It is not copied and must stay valid while it is used.
+*/
+void nio_keymap_set(const nio_keymap* keymap);
+
+/** Gets the keymap used by nio_getch().
+	@return Keymap
+*/
+const nio_keymap* nio_keymap_get(void);
+
 /** Immediately gets a char from the keyboard. For internal use.
     @param c Console
 	@return Char
@@ -185,6 +638,19 @@ char nio_getch(nio_console* c);
 */
 void nio_color(nio_console* c, const unsigned char background_color, const unsigned char foreground_color);
 
+/** Sets the palette of a console. Colors set with nio_color() are indices into it.
+	@param c Console
+	@param palette Array of 256 RGB565 colors, or NULL for the default palette. It is not copied and must stay valid while the console uses it.
+	\note If drawing is enabled, the console is redrawn with the new palette.
+*/
+void nio_palette_set(nio_console* c, const unsigned short* palette);
+
+/** Gets the palette of a console.
+	@param c Console
+	@return Array of 256 RGB565 colors
+*/
+const unsigned short* nio_palette_get(const nio_console* c);
+
 /** Changes the drawing behavior of a console.
 	@param c Console
 	@param enable_drawing If this is true, a console will automatically be updated if text is written to it.
@@ -218,6 +684,7 @@ void nio_free_stdio(void);
 
 /** See [fflush](http://www.cplusplus.com/reference/clibrary/cstdio/fflush/)
 	\note This is useful for consoles with enable_drawing set to false. Using this function will result in the console being drawn.
+	Only the cells that changed since the last flush are redrawn, and only the touched rows are pushed to the screen (see nio_present_policy()).
 */
 int nio_fflush(nio_console* c);
 
@@ -254,9 +721,43 @@ char* nio_fgets(char* str, int num, nio_console* c);
 */
 char* nio_gets(char* str);
 
-//int nio_vfprintf(nio_console* c, const char* format, va_list* arglist);
+/** Output function of the formatter. It gets the formatted text in chunks that are not null-terminated.
+	@param ctx Context passed to nio_vxprintf()
+	@param str Chars
+	@param len Number of chars
+*/
+typedef void (*nio_sink)(void* ctx, const char* str, int len);
+
+/** Formats text straight into a sink, without an intermediate buffer.
+	Supports the flags -, 0, +, space and #, width and precision (also as *), the
+	length modifiers h, hh, l, ll, z and the conversions d, i, u, x, X, o, c, s, p and %.
+	Floating point is not supported: f, F, e, E, g, G, a and A take their double
+	argument and are written out verbatim, like any other unknown conversion.
+	@param sink Output function
+	@param ctx Context passed to the sink
+	@param format Format string
+	@param arglist Arguments
+	@return Number of chars written
+*/
+int nio_vxprintf(nio_sink sink, void* ctx, const char* format, va_list arglist);
+
+/** See [vsnprintf](http://www.cplusplus.com/reference/clibrary/cstdio/vsnprintf/)
+	\note Uses the same formatter as nio_vxprintf().
+*/
+int nio_vsnprintf(char* str, size_t size, const char* format, va_list arglist);
+
+/** See [snprintf](http://www.cplusplus.com/reference/clibrary/cstdio/snprintf/)
+	\note Uses the same formatter as nio_vxprintf().
+*/
+int nio_snprintf(char* str, size_t size, const char* format, ...);
+
+/** See [vfprintf](http://www.cplusplus.com/reference/clibrary/cstdio/vfprintf/)
+	\note The text is written straight into the console, see nio_vxprintf() for the supported formats.
+*/
+int nio_vfprintf(nio_console* c, const char* format, va_list arglist);
 
 /** See [fprintf](http://www.cplusplus.com/reference/clibrary/cstdio/fprintf/)
+	\note See nio_vxprintf() for the supported formats.
 */
 int nio_fprintf(nio_console* c, const char* format, ...);
 
@@ -274,22 +775,384 @@ void nio_perror(const char* str);
 // Macro of nio_fputc
 #define nio_putc nio_fputc
 
-/** Stores binary data in a file.
+/** Computes a CRC-32 (as used by zlib and PNG).
+	@param crc CRC of the previous data, 0 to start
+	@param data Data
+	@param len Length in bytes
+	@return Updated CRC
+*/
+unsigned int nio_crc32(unsigned int crc, const void* data, size_t len);
+
+/** Input function of the decompressor. It fills a buffer with the next bytes of the stream.
+	@param ctx Context passed to nio_lz_decompress()
+	@param buf Buffer
+	@param len Size of the buffer
+	@return Number of bytes read, 0 at the end of the stream
+*/
+typedef int (*nio_source)(void* ctx, char* buf, int len);
+
+/** Size of the window of the LZ codec. Matches reach at most this far back. */
+#define NIO_LZ_WINDOW 4096
+
+/** Compresses data with the LZ codec of the registry.
+	@param src Data
+	@param size Length in bytes
+	@param dst Output buffer
+	@param dst_size Size of the output buffer
+	@return Compressed length, 0 if it does not fit in dst_size
+*/
+size_t nio_lz_compress(const void* src, size_t size, void* dst, size_t dst_size);
+
+/** Decompresses a stream made by nio_lz_compress(). The output is given to the sink in
+	chunks of up to NIO_LZ_WINDOW bytes, no full copy of the data is made.
+	@param source Input function
+	@param source_ctx Context passed to the input function
+	@param sink Output function
+	@param sink_ctx Context passed to the output function
+	@param length Length of the decompressed data
+	@return 0 on success, -1 if the stream is corrupt or too short
+*/
+int nio_lz_decompress(nio_source source, void* source_ctx, nio_sink sink, void* sink_ctx, size_t length);
+
+/** Default registry file used by reg_store() and reg_get(). */
+#ifndef REG_DEFAULT_PATH
+#define REG_DEFAULT_PATH "\\\\fls0\\prizmio.reg"
+#endif
+
+/** Entry of the index of a registry. */
+struct reg_entry
+{
+	char* key;
+	unsigned hash;
+	unsigned offset;
+	unsigned size;
+	unsigned length;
+	void* cache;
+	unsigned cache_size;
+	unsigned char state;
+};
+typedef struct reg_entry reg_entry;
+
+typedef struct reg_writer reg_writer;
+
+/** Most data of a registry mapped from the file at once, see reg_db_map(). */
+#define REG_MAX_MAPS 16
+
+/** Data of a registry mapped from the file. For internal use. */
+struct reg_mapping
+{
+	const void* ptr;
+	void* base;
+	size_t length;
+};
+typedef struct reg_mapping reg_mapping;
+
+/** Registry structure: many keys stored in one file, with an index kept in memory. */
+struct reg_db
+{
+	FILE* file;
+	reg_entry* entries;
+	int capacity;
+	int count;
+	unsigned start;
+	unsigned end;
+	unsigned garbage;
+	BOOL compress;
+	reg_writer* writer;
+	reg_mapping maps[REG_MAX_MAPS];
+	int mapped;
+};
+typedef struct reg_db reg_db;
+
+/** Data being written to a registry in pieces, see reg_db_writer_open(). */
+struct reg_writer
+{
+	reg_db* db;
+	char* key;
+	unsigned offset;
+	unsigned pos;
+	unsigned size;
+};
+
+/** Opens a registry file, creating it if needed, and loads its index.
+	@param db Registry
+	@param path File path
+	@return 0 on success, -1 on failure
+*/
+int reg_open(reg_db* db, const char* path);
+
+/** Commits and closes a registry.
+	@param db Registry
+*/
+void reg_close(reg_db* db);
+
+/** Stores binary data under a key. The data is copied to the cache of the registry and
+	written to the file by the next reg_db_commit(). Storing a key again before that only
+	replaces the cached copy.
+	@param db Registry
+	@param key Key, up to 255 chars
+	@param data Pointer to the data to be stored
+	@param size Length in bytes
+	@return 0 on success, -1 on failure
+*/
+int reg_db_store(reg_db* db, const char* key, const void* data, size_t size);
+
+/** Reads the data stored under a key, with one allocation of the exact size. The data
+	is served from the cache when possible, otherwise it is read from the file at once.
+	@param db Registry
+	@param key Key
+	@param size If not NULL, receives the length in bytes
+	@return Pointer to the data, to be freed with free(), NULL on failure
+*/
+void* reg_db_get(reg_db* db, const char* key, size_t* size);
+
+/** Gives the length of the data stored under a key.
+	@param db Registry
+	@param key Key
+	@return Length in bytes, -1 if the key is not found
+*/
+int reg_db_length(reg_db* db, const char* key);
+
+/** Reads the data stored under a key into a buffer of the caller.
+	Compressed data is decompressed straight into the buffer.
+	@param db Registry
+	@param key Key
+	@param buf Buffer
+	@param size Size of the buffer
+	@return Length of the data, -1 if the key is not found or the buffer is too small
+*/
+int reg_db_read(reg_db* db, const char* key, void* buf, size_t size);
+
+/** Reads the data stored under a key in chunks, see nio_sink. Compressed data is
+	decompressed on the fly.
+	@param db Registry
+	@param key Key
+	@param sink Output function
+	@param ctx Context passed to the sink
+	@return 0 on success, -1 on failure
+*/
+int reg_db_stream(reg_db* db, const char* key, nio_sink sink, void* ctx);
+
+/** Starts writing data of a known length under a key, in pieces, straight to the file.
+	Nothing is kept in memory, so this is how large data received from somewhere else
+	should be stored. Only one writer can be open on a registry, and commits wait for it.
+	@param db Registry
+	@param w Writer
+	@param key Key, up to 255 chars
+	@param size Length of the data in bytes
+	@return 0 on success, -1 on failure
+*/
+int reg_db_writer_open(reg_db* db, reg_writer* w, const char* key, size_t size);
+
+/** Writes the next piece of data.
+	@param w Writer
+	@param data Data
+	@param len Length in bytes
+	@return 0 on success, -1 on failure or if this goes past the length given to reg_db_writer_open()
+*/
+int reg_writer_write(reg_writer* w, const void* data, size_t len);
+
+/** Ends writing. The key only gets the new data here, if all of it was written.
+	@param w Writer
+	@return 0 on success, -1 on failure
+*/
+int reg_writer_close(reg_writer* w);
+
+/** Ends writing and drops what was written. The key is left as it was.
+	@param w Writer
+*/
+void reg_writer_abort(reg_writer* w);
+
+/** Enables compression of the data written by the next commits. Data is only stored
+	compressed when that makes it smaller. Compressed and plain data can be read either way.
+	@param db Registry
+	@param enable TRUE to compress
+*/
+void reg_db_compression(reg_db* db, const BOOL enable);
+
+/** Gives read-only access to the data stored under a key without copying it.
+	On Linux the data is mapped from the file with mmap. On the calculator it is
+	loaded into the cache once and lent from there.
+	@param db Registry
+	@param key Key
+	@param size If not NULL, receives the length in bytes
+	@return Pointer to the data, NULL on failure. It stays valid until reg_db_unmap()
+	is called, and must not be used after the key is stored again, removed or the registry closed.
+	Compaction moves the data in the file, so reg_db_commit() does not compact while data is
+	mapped and reg_db_compact() fails.
+*/
+const void* reg_db_map(reg_db* db, const char* key, size_t* size);
+
+/** Ends an access started with reg_db_map().
+	@param db Registry
+	@param ptr Pointer returned by reg_db_map()
+*/
+void reg_db_unmap(reg_db* db, const void* ptr);
+
+/** Removes a key. Like reg_db_store(), this only reaches the file on reg_db_commit().
+	@param db Registry
+	@param key Key
+	@return 0 on success, -1 if the key does not exist or on failure
+*/
+int reg_db_delete(reg_db* db, const char* key);
+
+/** Writes all pending changes to the file, in one pass. The file is compacted
+	once old data takes more than half of it, unless data is mapped with reg_db_map().
+	reg_close() commits as well.
+	@param db Registry
+	@return 0 on success, -1 on failure
+*/
+int reg_db_commit(reg_db* db);
+
+/** Commits a registry and reclaims the space taken by overwritten and deleted data.
+	On Linux the file is shrunk to what is left. On the calculator it keeps its size
+	and the next records reuse the space.
+	@param db Registry
+	@return 0 on success, -1 on failure or while data is mapped with reg_db_map()
+*/
+int reg_db_compact(reg_db* db);
+
+/** Sets the registry used by reg_store() and reg_get(). By default, REG_DEFAULT_PATH is opened on first use.
+	@param db Registry
+*/
+void reg_set_default(reg_db* db);
+
+/** Gives the default registry, opening it on first use.
+	@return Registry, NULL if it could not be opened
+*/
+reg_db* reg_get_default(void);
+
+/** Enables compression of the default registry, see reg_db_compression().
+	@param enable TRUE to compress
+*/
+void reg_compression(const BOOL enable);
+
+/** Commits the default registry, see reg_db_commit(). This is also done when the program exits.
+	@return 0 on success, -1 on failure
+*/
+int reg_commit(void);
+
+/** Stores binary data in the default registry.
+	\note The data is written to flash by reg_commit().
 	@param dataptr Pointer to the data to be stored
 	@param size Length in bytes
-	@param regpath Path to file
+	@param regpath Key
 	@return 0 on success, -1 on failure
 */
 int reg_store(void* dataptr, size_t size, char* regpath);
 
-/** Reads binary data from a file.
-	@param regpath Path to file
-	@return Pointer to the data, NULL on failure
+/** Reads binary data from the default registry. If the key is not there, the file
+	at regpath is read instead, for data stored by older versions.
+	@param regpath Key
+	@return Pointer to the data, to be freed with free(), NULL on failure
 */
 void* reg_get(char* regpath);
 
+/** Like reg_get(), and also gives the length of the data.
+	@param regpath Key
+	@param size If not NULL, receives the length in bytes
+	@return Pointer to the data, to be freed with free(), NULL on failure
+*/
+void* reg_read(char* regpath, size_t* size);
+
+/** Gives read-only access to data of the default registry without copying it, see reg_db_map().
+	@param regpath Key
+	@param size If not NULL, receives the length in bytes
+	@return Pointer to the data, NULL on failure
+*/
+const void* reg_map(char* regpath, size_t* size);
+
+/** Ends an access started with reg_map().
+	@param ptr Pointer returned by reg_map()
+*/
+void reg_unmap(const void* ptr);
+
+/** Loads a console stored with nio_reg_save(). The cells are decompressed straight into
+	the new console. The console must not be initialized, and is left untouched on failure.
+	@param db Registry, NULL for the default one
+	@param key Key
+	@param c Console
+	@return 0 on success, -1 on failure
+*/
+int nio_reg_load(reg_db* db, const char* key, nio_console* c);
+
+/** Stores a console in a registry. It is written by the next commit, compressed if the
+	registry has compression enabled.
+	@param db Registry, NULL for the default one
+	@param key Key
+	@param c Console
+	@return 0 on success, -1 on failure
+*/
+int nio_reg_save(reg_db* db, const char* key, const nio_console* c);
+
+/** Size of the transmit and receive rings of the serial port, a power of 2. */
+#ifndef UART_BUFFER_SIZE
+#define UART_BUFFER_SIZE 256
+#endif
+
+/** Time in ms a write waits for the backend to take something before giving up, as when the port is not open. */
+#ifndef UART_TIMEOUT
+#define UART_TIMEOUT 1000
+#endif
+
+/** Backend of the serial port. The calls must not block: write and read move what they
+	can and return the number of bytes moved, which may be 0.
+*/
+struct uart_backend
+{
+	int (*open)(void* ctx, int baud);
+	void (*close)(void* ctx);
+	int (*write)(void* ctx, const char* buf, int len);
+	int (*read)(void* ctx, char* buf, int len);
+	void* ctx;
+};
+typedef struct uart_backend uart_backend;
+
+/** Backend using the 3-pin port of the calculator. This is the default. */
+extern const uart_backend uart_serial;
+
+/** Backend giving back everything written to it, to test without a cable. */
+extern const uart_backend uart_loopback;
+
+/** Sets the backend of the serial port. Bytes still in the rings are dropped.
+	@param backend Backend, NULL for uart_serial
+*/
+void uart_backend_set(const uart_backend* backend);
+
+/** Opens the serial port with 8 data bits, no parity and 1 stop bit.
+	@param baud Speed, from 300 to 115200 bauds
+	@return 0 on success, -1 on failure
+*/
+int uart_open(int baud);
+
+/** Sends what is left in the transmit ring and closes the serial port. */
+void uart_close(void);
+
+/** Writes bytes to the serial port. They are queued in the transmit ring and sent in
+	blocks. This only waits when the ring is full, for UART_TIMEOUT ms at most.
+	@param buf Bytes
+	@param len Number of bytes
+	@return Number of bytes written, fewer if the backend stopped taking them
+*/
+int uart_write(const void* buf, int len);
+
+/** Reads the bytes received so far, without waiting.
+	@param buf Destination
+	@param len Size of the destination
+	@return Number of bytes read, 0 if nothing was received
+*/
+int uart_read(void* buf, int len);
+
+/** Waits until everything in the transmit ring is sent, or until the backend takes nothing for UART_TIMEOUT ms. */
+void uart_flush(void);
+
+/** Moves the rings without waiting: sends what the backend takes and receives what it has.
+	Call it regularly to keep data moving when no other uart_* call is made.
+*/
+void uart_poll(void);
+
 /** Checks if there is data available at the serial port.
-	@return TRUE if new data is available.
+	@return TRUE if new data is available, see uart_read().
 */
 BOOL uart_ready(void);
 
@@ -304,6 +1167,8 @@ char uart_getchar(void);
 char* uart_gets(char* str);
 
 /** See [putchar](http://www.cplusplus.com/reference/clibrary/cstdio/putchar/)
+	\note The char is queued, it is sent at the end of the line, when the transmit ring is full, or by uart_flush().
+	It is dropped if the ring is full and the backend takes nothing for UART_TIMEOUT ms.
 */
 char uart_putchar(char character);
 
@@ -316,10 +1181,219 @@ int uart_puts(const char *str);
 */
 void uart_printf(char *format, ...);
 
+/** Largest payload of a frame of uart_send(). */
+#ifndef UART_XFER_PAYLOAD
+#define UART_XFER_PAYLOAD 256
+#endif
+
+/** Number of frames uart_send() keeps in flight. */
+#ifndef UART_XFER_WINDOW
+#define UART_XFER_WINDOW 8
+#endif
+
+/** Sends data to uart_receive_reg() on the other end of the serial port. The data is cut
+	in frames checked with a CRC-32, several frames are in flight at once, and lost or bad
+	ones are sent again. Only the frames in flight are kept in memory.
+	@param name Name of the data, stored as the key on the other end
+	@param size Length of the data in bytes
+	@param source Input function giving the data
+	@param ctx Context passed to the input function
+	@return 0 when the other end has everything, -1 on failure
+*/
+int uart_send(const char* name, size_t size, nio_source source, void* ctx);
+
+/** Sends a key of a registry with uart_send().
+	@param db Registry, NULL for the default one
+	@param key Key
+	@return 0 on success, -1 on failure
+*/
+int uart_send_reg(reg_db* db, const char* key);
+
+/** Receives data sent by uart_send() and writes it to a registry as it comes, see reg_db_writer_open().
+	The key is left untouched if the transfer fails.
+	@param db Registry, NULL for the default one
+	@param key Receives the name of the data, which is the key it is stored under
+	@param key_size Size of key
+	@return 0 on success, -1 on failure or if nothing comes for 10 seconds
+*/
+int uart_receive_reg(reg_db* db, char* key, int key_size);
+
 /** Returns the current time.
-	@return Current RTC time
+	@return Current RTC time in ms. It goes back to 0 at midnight, only differences are
+	meaningful, see nio_time_since().
+*/
+unsigned nio_time_get(void);
+
+/** Returns the time since an earlier nio_time_get(). The RTC going back to 0 at midnight
+	is taken into account, for spans shorter than a day.
+	@param start Earlier time in ms
+	@return Time in ms
+*/
+unsigned nio_time_since(const unsigned start);
+
+/** Returns the high-resolution timer. On the calculator it is channel 2 of the TMU, started
+	on the first call, and on a computer the monotonic clock in microseconds.
+	@return Timer ticks, see nio_timer_hz(). It wraps around, only differences are meaningful.
+*/
+unsigned nio_timer_ticks(void);
+
+/** Returns the rate of nio_timer_ticks(). On the calculator it depends on the clock settings,
+	and the first call measures it against the RTC, which takes 125 ms.
+	@return Ticks per second
+*/
+unsigned nio_timer_hz(void);
+
+/** Converts timer ticks to microseconds.
+	@param ticks Timer ticks
+	@return Microseconds
+*/
+unsigned long nio_timer_us(const unsigned ticks);
+
+/** Number of profiling zones. */
+#ifndef NIO_PROF_ZONES
+#define NIO_PROF_ZONES 32
+#endif
+
+/** Times of a profiling zone, in timer ticks. */
+struct nio_prof_zone
+{
+	const char* name;
+	/** Number of times the zone was run */
+	unsigned long count;
+	unsigned min;
+	unsigned max;
+	unsigned long long total;
+	/** Time of the last nio_prof_begin() */
+	unsigned start;
+};
+typedef struct nio_prof_zone nio_prof_zone;
+
+/** Gets a profiling zone by name, adding it on first use. Zones are kept in a fixed table
+	of NIO_PROF_ZONES entries and are never removed.
+	@param name Name of the zone. It is not copied and must stay valid, like a string literal.
+	@return Zone, -1 if the table is full
+*/
+int nio_prof_zone_get(const char* name);
+
+/** Starts timing a run of a zone. Zones can be nested, but a zone cannot be nested in itself.
+	@param zone Zone from nio_prof_zone_get(), -1 is ignored
+*/
+void nio_prof_begin(const int zone);
+
+/** Ends the run of a zone started by nio_prof_begin() and adds its time to the zone.
+	@param zone Zone from nio_prof_zone_get(), -1 is ignored
+*/
+void nio_prof_end(const int zone);
+
+/** Gets the times of a profiling zone.
+	@param zone Zone from nio_prof_zone_get()
+	@return Zone, NULL if there is no such zone
+*/
+const nio_prof_zone* nio_prof_get(const int zone);
+
+/** Sets the times of all profiling zones back to 0. The zones are kept. */
+void nio_prof_reset(void);
+
+/** Prints the count and the min, average and max time of each profiling zone in microseconds.
+	@param c Console, NULL to send it over the UART
+*/
+void nio_prof_dump(nio_console* c);
+
+/** Number of events kept by the trace, a power of 2. */
+#ifndef NIO_TRACE_SIZE
+#define NIO_TRACE_SIZE 256
+#endif
+
+/** Types of trace events, with what a and b hold. Events with a duration are recorded when they end. */
+#define NIO_TRACE_SCROLL    1 // nio_scroll(), a: 1 if the pixels were moved, with a duration
+#define NIO_TRACE_FLUSH     2 // nio_fflush(), a: chars drawn, with a duration
+#define NIO_TRACE_PRESENT   3 // push to the screen, a: first row, b: last row, with a duration
+#define NIO_TRACE_KEY       4 // keyboard event, a: NIO_KBD_PRESS, NIO_KBD_RELEASE or NIO_KBD_REPEAT, b: key
+#define NIO_TRACE_REG_READ  5 // registry data read from the file, a: low bits of the key hash, b: bytes, with a duration
+#define NIO_TRACE_REG_WRITE 6 // registry data written to the file, a: low bits of the key hash, b: bytes, with a duration
+#define NIO_TRACE_UART_TX   7 // bytes given to the UART backend, b: bytes
+#define NIO_TRACE_UART_RX   8 // bytes taken from the UART backend, b: bytes
+/** First type free for the events of a program. */
+#define NIO_TRACE_USER      0x100
+
+/** Trace event. */
+struct nio_trace_event
+{
+	/** Start of the event in timer ticks, see nio_timer_ticks() */
+	unsigned time;
+	/** Length of the event in timer ticks, 0 for a point in time */
+	unsigned duration;
+	unsigned short type;
+	unsigned short a;
+	unsigned b;
+};
+typedef struct nio_trace_event nio_trace_event;
+
+/** Starts or stops recording trace events. Recording is off by default. It only takes
+	a few stores per event, so it can be left on.
+	@param enable TRUE to record
+*/
+void nio_trace_enable(const BOOL enable);
+
+/** Tells whether trace events are recorded.
+	@return TRUE if recording
+*/
+BOOL nio_trace_enabled(void);
+
+/** Drops all recorded trace events. */
+void nio_trace_clear(void);
+
+/** Records a trace event at the current time. Programs can record their own events
+	from NIO_TRACE_USER on.
+	@param type Type of the event
+	@param a Payload, 16 bits
+	@param b Payload, 32 bits
+*/
+void nio_trace(const int type, const unsigned a, const unsigned b);
+
+/** Starts a trace event with a duration. For internal use.
+	@return Start time to pass to nio_trace_end()
+*/
+unsigned nio_trace_begin(void);
+
+/** Records a trace event started by nio_trace_begin(). For internal use.
+	@param type Type of the event
+	@param a Payload, 16 bits
+	@param b Payload, 32 bits
+	@param start Value returned by nio_trace_begin()
+*/
+void nio_trace_end(const int type, const unsigned a, const unsigned b, const unsigned start);
+
+/** Returns the number of trace events kept, at most NIO_TRACE_SIZE.
+	@return Number of events
+*/
+int nio_trace_count(void);
+
+/** Returns the size of the dump nio_trace_export() would give now.
+	@return Size in bytes
+*/
+size_t nio_trace_dump_size(void);
+
+/** Writes a binary dump of the trace events, from the oldest. The dump is big-endian on
+	every machine, tools/trace2json.c turns it into a Chrome trace.
+	@param sink Output function
+	@param ctx Context passed to the output function
+	@return Size of the dump in bytes
+*/
+int nio_trace_export(nio_sink sink, void* ctx);
+
+/** Sends a dump of the trace events as is over the UART, see nio_trace_export().
+	@return Size of the dump in bytes
+*/
+int nio_trace_send(void);
+
+/** Stores a dump of the trace events in a registry, see nio_trace_export(). The record is
+	not compressed, so the dump can also be found in the registry file as it is.
+	@param db Registry, NULL for the default one
+	@param key Key
+	@return 0 on success, -1 on failure
 */
-inline unsigned nio_time_get();
+int nio_trace_store(reg_db* db, const char* key);
 
 /** Draws the cursor of the console, if enabled.
 	@param c Console
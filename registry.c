@@ -27,38 +27,929 @@
  */
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#if defined(__linux__)
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
 #include "prizmio.h"
-	
-int reg_store(void* dataptr, size_t size, char* regpath)
+
+/* A registry file holds many keys. It starts with a header
+ *   magic (4 bytes), version (2), reserved (2), end (4), start (4)
+ * followed by records
+ *   flags (1), key length (1), reserved (2), size (4), key, data
+ * from the start offset (0 means right after the header) up to the end
+ * offset. Records are only ever appended: the last record of a key wins,
+ * and a record with REG_RECORD_DELETED removes it. The space taken by
+ * older records is reclaimed by reg_db_compact(), which shrinks the file on
+ * Linux. On the calculator the file keeps its size, past the end is unused.
+ * With REG_RECORD_LZ the data is the length of the plain data (4 bytes)
+ * followed by its nio_lz_compress() stream.
+ * Numbers are stored in the byte order of the machine.
+ */
+#define REG_MAGIC 0x4E494F52 // "NIOR"
+#define REG_VERSION 1
+#define REG_HEADER_SIZE 16
+#define REG_RECORD_SIZE 8
+#define REG_RECORD_DELETED 0x01
+#define REG_RECORD_LZ      0x02
+
+// Smaller data is always stored plain
+#define REG_LZ_MIN 32
+
+// Compact when the garbage is more than half the file and at least this big
+#define REG_COMPACT_MIN 4096
+
+#define REG_EMPTY ((unsigned)-1)
+
+// State of an entry
+#define REG_CACHED  0x01 // cache holds the data
+#define REG_DIRTY   0x02 // the file is behind the cache
+#define REG_DELETED 0x04 // removed, but the file still has it
+#define REG_PACKED  0x08 // the record in the file is compressed
+
+static reg_db* reg_default = NULL;
+static reg_db reg_default_db;
+
+struct reg_header
+{
+	unsigned int magic;
+	unsigned short version;
+	unsigned short reserved;
+	unsigned int end;
+	unsigned int start;
+};
+
+struct reg_record
+{
+	unsigned char flags;
+	unsigned char key_len;
+	unsigned short reserved;
+	unsigned int size;
+};
+
+static unsigned reg_hash(const char* key)
+{
+	unsigned h = 2166136261u;
+	while(*key)
+		h = (h ^ (unsigned char)*key++) * 16777619u;
+	return h;
+}
+
+// Finds the slot of a key, or the empty slot where it would go.
+static reg_entry* reg_find(const reg_db* db, const char* key, unsigned hash)
+{
+	unsigned mask = db->capacity-1;
+	unsigned i = hash & mask;
+	while(db->entries[i].key != NULL)
+	{
+		if(db->entries[i].hash == hash && !strcmp(db->entries[i].key, key))
+			break;
+		i = (i+1) & mask;
+	}
+	return &db->entries[i];
+}
+
+static BOOL reg_grow(reg_db* db)
+{
+	reg_entry* old = db->entries;
+	int old_capacity = db->capacity;
+	int i;
+	db->capacity = old_capacity ? old_capacity*2 : 16;
+	db->entries = calloc(db->capacity, sizeof(reg_entry));
+	if(db->entries == NULL)
+	{
+		db->entries = old;
+		db->capacity = old_capacity;
+		return FALSE;
+	}
+	for(i = 0; i < old_capacity; i++)
+	{
+		if(old[i].key != NULL)
+			*reg_find(db, old[i].key, old[i].hash) = old[i];
+	}
+	free(old);
+	return TRUE;
+}
+
+// Returns the entry of a key, adding it if needed.
+static reg_entry* reg_insert(reg_db* db, const char* key)
+{
+	unsigned hash = reg_hash(key);
+	reg_entry* e;
+	if((db->count+1)*4 > db->capacity*3 && !reg_grow(db))
+		return NULL;
+	e = reg_find(db, key, hash);
+	if(e->key == NULL)
+	{
+		e->key = malloc(strlen(key)+1);
+		if(e->key == NULL)
+			return NULL;
+		strcpy(e->key, key);
+		e->hash = hash;
+		e->offset = REG_EMPTY;
+		e->size = 0;
+		e->length = 0;
+		e->cache = NULL;
+		e->cache_size = 0;
+		e->state = 0;
+		db->count++;
+	}
+	return e;
+}
+
+static unsigned reg_record_size(const reg_entry* e)
+{
+	return REG_RECORD_SIZE+strlen(e->key)+e->size;
+}
+
+// Moves the end and the start of the records with a single write.
+static BOOL reg_write_bounds(reg_db* db)
+{
+	unsigned int bounds[2];
+	bounds[0] = db->end;
+	bounds[1] = db->start;
+	return fseek(db->file, 8, SEEK_SET) == 0 && fwrite(bounds, sizeof(bounds), 1, db->file) == 1 && fflush(db->file) == 0;
+}
+
+static BOOL reg_append(reg_db* db, const char* key, unsigned char flags, const void* data, size_t size, unsigned* offset)
+{
+	struct reg_record r;
+	r.flags = flags;
+	r.key_len = strlen(key);
+	r.reserved = 0;
+	r.size = size;
+	if(fseek(db->file, db->end, SEEK_SET) != 0
+		|| fwrite(&r, REG_RECORD_SIZE, 1, db->file) != 1
+		|| fwrite(key, 1, r.key_len, db->file) != (size_t)r.key_len
+		|| (size && fwrite(data, 1, size, db->file) != size))
+		return FALSE;
+	*offset = db->end;
+	db->end += REG_RECORD_SIZE+r.key_len+size;
+	return TRUE;
+}
+
+static BOOL reg_load(reg_db* db)
+{
+	struct reg_header h;
+	unsigned pos;
+	char key[256];
+	if(fread(&h, REG_HEADER_SIZE, 1, db->file) != 1 || h.magic != REG_MAGIC || h.version != REG_VERSION)
+		return FALSE;
+	db->end = h.end;
+	db->start = h.start ? h.start : REG_HEADER_SIZE;
+	if(db->start < REG_HEADER_SIZE || db->start > db->end)
+		return FALSE;
+	// What is before the start is left over from a compaction
+	db->garbage = db->start-REG_HEADER_SIZE;
+	for(pos = db->start; pos < db->end; )
+	{
+		struct reg_record r;
+		reg_entry* e;
+		// pos < end, so the differences below cannot wrap
+		if(fseek(db->file, pos, SEEK_SET) != 0
+			|| fread(&r, REG_RECORD_SIZE, 1, db->file) != 1
+			|| db->end-pos < REG_RECORD_SIZE+(unsigned)r.key_len
+			|| r.size > db->end-pos-REG_RECORD_SIZE-r.key_len
+			|| fread(key, 1, r.key_len, db->file) != (size_t)r.key_len)
+			return FALSE;
+		key[r.key_len] = '\0';
+		e = reg_insert(db, key);
+		if(e == NULL)
+			return FALSE;
+		if(e->offset != REG_EMPTY)
+			db->garbage += reg_record_size(e);
+		if(r.flags & REG_RECORD_DELETED)
+		{
+			db->garbage += REG_RECORD_SIZE+r.key_len;
+			e->offset = REG_EMPTY;
+			e->size = 0;
+		}
+		else
+		{
+			e->offset = pos;
+			e->size = r.size;
+			e->length = r.size;
+			e->state &= ~REG_PACKED;
+			if(r.flags & REG_RECORD_LZ)
+			{
+				unsigned int length;
+				if(r.size < sizeof(length) || fread(&length, sizeof(length), 1, db->file) != 1)
+					return FALSE;
+				e->length = length;
+				e->state |= REG_PACKED;
+			}
+		}
+		pos += REG_RECORD_SIZE+r.key_len+r.size;
+	}
+	return TRUE;
+}
+
+// Frees a registry and closes its file, without writing anything.
+static void reg_free(reg_db* db)
+{
+	int i;
+	for(i = 0; i < db->capacity; i++)
+	{
+		free(db->entries[i].key);
+		free(db->entries[i].cache);
+	}
+	free(db->entries);
+	if(db->file != NULL)
+		fclose(db->file);
+	if(reg_default == db)
+		reg_default = NULL;
+	memset(db, 0, sizeof(reg_db));
+}
+
+int reg_open(reg_db* db, const char* path)
+{
+	memset(db, 0, sizeof(reg_db));
+	db->file = fopen(path, "r+b");
+	if(db->file == NULL)
+	{
+		struct reg_header h;
+		memset(&h, 0, REG_HEADER_SIZE);
+		h.magic = REG_MAGIC;
+		h.version = REG_VERSION;
+		h.end = REG_HEADER_SIZE;
+		h.start = REG_HEADER_SIZE;
+		db->file = fopen(path, "w+b");
+		if(db->file == NULL)
+			return -1;
+		if(fwrite(&h, REG_HEADER_SIZE, 1, db->file) != 1)
+		{
+			reg_free(db);
+			return -1;
+		}
+		rewind(db->file);
+	}
+	// A file that failed to load is left as it is
+	if(!reg_grow(db) || !reg_load(db))
+	{
+		reg_free(db);
+		return -1;
+	}
+	return 0;
+}
+
+void reg_close(reg_db* db)
+{
+	int i;
+	// The maps cannot be used after this, so they do not hold back compaction
+	for(i = 0; i < REG_MAX_MAPS; i++)
+	{
+		if(db->maps[i].ptr != NULL)
+			reg_db_unmap(db, db->maps[i].ptr);
+	}
+	reg_db_commit(db);
+	reg_free(db);
+}
+
+int reg_db_store(reg_db* db, const char* key, const void* data, size_t size)
+{
+	reg_entry* e;
+	void* copy;
+	if(strlen(key) > 255)
+		return -1;
+	e = reg_insert(db, key);
+	copy = malloc(size ? size : 1);
+	if(e == NULL || copy == NULL)
+	{
+		free(copy);
+		return -1;
+	}
+	// Only the cache is updated, the file is written by reg_db_commit()
+	memcpy(copy, data, size);
+	free(e->cache);
+	e->cache = copy;
+	e->cache_size = size;
+	e->state = REG_CACHED | REG_DIRTY;
+	return 0;
+}
+
+// Lookup shared by the readers, NULL if the key has no data.
+static reg_entry* reg_lookup(reg_db* db, const char* key)
+{
+	reg_entry* e = reg_find(db, key, reg_hash(key));
+	if(e->key == NULL || (e->state & REG_DELETED) || (!(e->state & REG_CACHED) && e->offset == REG_EMPTY))
+		return NULL;
+	return e;
+}
+
+static unsigned reg_data_offset(const reg_entry* e)
+{
+	return e->offset+REG_RECORD_SIZE+strlen(e->key);
+}
+
+struct reg_source
 {
 	FILE* file;
-	
-	file = fopen(regpath,"wb");
-	if(file == NULL)
+	unsigned left;
+};
+
+static int reg_source_read(void* ctx, char* buf, int len)
+{
+	struct reg_source* src = ctx;
+	int n = src->left < (unsigned)len ? (int)src->left : len;
+	n = fread(buf, 1, n, src->file);
+	src->left -= n;
+	return n;
+}
+
+int reg_db_stream(reg_db* db, const char* key, nio_sink sink, void* ctx)
+{
+	reg_entry* e = reg_lookup(db, key);
+	struct reg_source src;
+	unsigned start;
+	if(e == NULL)
 		return -1;
-	fwrite(dataptr,1,size,file);
-	fclose(file);
-	
+	if(e->state & REG_CACHED)
+	{
+		if(e->cache_size)
+			sink(ctx, e->cache, e->cache_size);
+		return 0;
+	}
+	start = nio_trace_begin();
+	src.file = db->file;
+	src.left = e->size;
+	if(fseek(db->file, reg_data_offset(e), SEEK_SET) != 0)
+		return -1;
+	if(e->state & REG_PACKED)
+	{
+		int result;
+		// Skip the length, it is already in the index
+		src.left -= sizeof(unsigned int);
+		if(fseek(db->file, sizeof(unsigned int), SEEK_CUR) != 0)
+			return -1;
+		result = nio_lz_decompress(reg_source_read, &src, sink, ctx, e->length);
+		nio_trace_end(NIO_TRACE_REG_READ, e->hash, e->size, start);
+		return result;
+	}
+	while(src.left > 0)
+	{
+		char buf[128];
+		int n = reg_source_read(&src, buf, sizeof(buf));
+		if(n <= 0)
+			return -1;
+		sink(ctx, buf, n);
+	}
+	nio_trace_end(NIO_TRACE_REG_READ, e->hash, e->size, start);
 	return 0;
 }
 
-void* reg_get(char* regpath)
+struct reg_buffer
+{
+	char* buf;
+	size_t size;
+	size_t pos;
+};
+
+static void reg_buffer_write(void* ctx, const char* str, int len)
+{
+	struct reg_buffer* b = ctx;
+	if(b->pos+len <= b->size)
+		memcpy(b->buf+b->pos, str, len);
+	b->pos += len;
+}
+
+int reg_db_length(reg_db* db, const char* key)
+{
+	reg_entry* e = reg_lookup(db, key);
+	if(e == NULL)
+		return -1;
+	return (e->state & REG_CACHED) ? e->cache_size : e->length;
+}
+
+int reg_db_read(reg_db* db, const char* key, void* buf, size_t size)
+{
+	struct reg_buffer b;
+	int length = reg_db_length(db, key);
+	if(length < 0 || (size_t)length > size)
+		return -1;
+	b.buf = buf;
+	b.size = length;
+	b.pos = 0;
+	if(reg_db_stream(db, key, reg_buffer_write, &b) != 0 || b.pos != (size_t)length)
+		return -1;
+	return length;
+}
+
+void* reg_db_get(reg_db* db, const char* key, size_t* size)
 {
-/*	struct stat fstat;
+	// The length is known from the index: one allocation, filled in place
+	int length = reg_db_length(db, key);
 	void* result;
-	FILE* file;
-	
-	//if(stat(regpath,&fstat) == -1)
+	if(length < 0)
 		return NULL;
-	result = malloc(fstat.st_size);
+	// malloc(0) may return NULL, so allocate at least a byte
+	result = malloc(length ? length : 1);
 	if(result == NULL)
 		return NULL;
-	file = fopen(regpath,"rb");
+	if(reg_db_read(db, key, result, length) != length)
+	{
+		free(result);
+		return NULL;
+	}
+	if(size != NULL)
+		*size = length;
+	return result;
+}
+
+void reg_db_compression(reg_db* db, const BOOL enable)
+{
+	db->compress = enable;
+}
+
+const void* reg_db_map(reg_db* db, const char* key, size_t* size)
+{
+	reg_entry* e = reg_lookup(db, key);
+	if(e == NULL)
+		return NULL;
+#if defined(__linux__)
+	// Map the data straight from the file, the pages are only loaded when used
+	if(!(e->state & (REG_CACHED | REG_PACKED)) && e->size > 0)
+	{
+		int i;
+		for(i = 0; i < REG_MAX_MAPS && db->maps[i].ptr != NULL; i++);
+		if(i < REG_MAX_MAPS)
+		{
+			long page = sysconf(_SC_PAGESIZE);
+			unsigned offset = reg_data_offset(e);
+			unsigned start = offset - offset%page;
+			size_t length = e->size+(offset-start);
+			void* base = mmap(NULL, length, PROT_READ, MAP_SHARED, fileno(db->file), start);
+			if(base != MAP_FAILED)
+			{
+				db->maps[i].base = base;
+				db->maps[i].length = length;
+				db->maps[i].ptr = (char*)base+(offset-start);
+				db->mapped++;
+				if(size != NULL)
+					*size = e->size;
+				return db->maps[i].ptr;
+			}
+		}
+	}
+#endif
+	// Without mmap, the data is loaded into the cache once and lent from there
+	if(!(e->state & REG_CACHED))
+	{
+		void* cache = reg_db_get(db, key, NULL);
+		if(cache == NULL)
+			return NULL;
+		e->cache = cache;
+		e->cache_size = e->length;
+		e->state |= REG_CACHED;
+	}
+	if(size != NULL)
+		*size = e->cache_size;
+	return e->cache;
+}
+
+void reg_db_unmap(reg_db* db, const void* ptr)
+{
+#if defined(__linux__)
+	int i;
+	for(i = 0; i < REG_MAX_MAPS; i++)
+	{
+		if(db->maps[i].ptr == ptr && ptr != NULL)
+		{
+			munmap(db->maps[i].base, db->maps[i].length);
+			db->maps[i].ptr = NULL;
+			db->mapped--;
+			return;
+		}
+	}
+#endif
+	// Cached data stays in the cache
+	(void)db;
+	(void)ptr;
+}
+
+int reg_db_delete(reg_db* db, const char* key)
+{
+	reg_entry* e = reg_find(db, key, reg_hash(key));
+	if(e->key == NULL || (e->state & REG_DELETED) || (!(e->state & REG_CACHED) && e->offset == REG_EMPTY))
+		return -1;
+	free(e->cache);
+	e->cache = NULL;
+	e->cache_size = 0;
+	// Data that never reached the file can simply be forgotten
+	e->state = e->offset == REG_EMPTY ? 0 : REG_DELETED | REG_DIRTY;
+	return 0;
+}
+
+// Writes the pending changes to the file.
+static int reg_flush(reg_db* db)
+{
+	int i, result = 0;
+	BOOL written = FALSE;
+	if(db->file == NULL)
+		return -1;
+	// Records go after the one being written, once it is done
+	if(db->writer != NULL)
+		return 0;
+	// Append every pending change, then move the end once
+	for(i = 0; i < db->capacity; i++)
+	{
+		reg_entry* e = &db->entries[i];
+		unsigned offset;
+		if(e->key == NULL || !(e->state & REG_DIRTY))
+			continue;
+		if(e->state & REG_DELETED)
+		{
+			if(!reg_append(db, e->key, REG_RECORD_DELETED, NULL, 0, &offset))
+			{
+				result = -1;
+				break;
+			}
+			db->garbage += reg_record_size(e)+REG_RECORD_SIZE+strlen(e->key);
+			e->offset = REG_EMPTY;
+			e->size = 0;
+			e->state = 0;
+		}
+		else
+		{
+			unsigned char* packed = NULL;
+			size_t size = 0;
+			unsigned start = nio_trace_begin();
+			if(db->compress && e->cache_size >= REG_LZ_MIN)
+			{
+				// Keep the compressed data only if it is smaller, length included
+				unsigned int length = e->cache_size;
+				packed = malloc(e->cache_size);
+				if(packed != NULL)
+				{
+					memcpy(packed, &length, sizeof(length));
+					size = nio_lz_compress(e->cache, e->cache_size, packed+sizeof(length), e->cache_size-sizeof(length)-1);
+				}
+				if(size == 0)
+				{
+					free(packed);
+					packed = NULL;
+				}
+				else
+					size += sizeof(length);
+			}
+			if(packed == NULL)
+				size = e->cache_size;
+			if(!reg_append(db, e->key, packed != NULL ? REG_RECORD_LZ : 0, packed != NULL ? packed : e->cache, size, &offset))
+			{
+				free(packed);
+				result = -1;
+				break;
+			}
+			if(e->offset != REG_EMPTY)
+				db->garbage += reg_record_size(e);
+			e->offset = offset;
+			e->size = size;
+			e->length = e->cache_size;
+			e->state &= ~(REG_DIRTY | REG_PACKED);
+			if(packed != NULL)
+				e->state |= REG_PACKED;
+			free(packed);
+			nio_trace_end(NIO_TRACE_REG_WRITE, e->hash, size, start);
+		}
+		written = TRUE;
+	}
+	// The records are only part of the file once the end covers them
+	if(written && !reg_write_bounds(db))
+		return -1;
+	return result;
+}
+
+static int reg_compact(reg_db* db);
+
+int reg_db_commit(reg_db* db)
+{
+	if(reg_flush(db) != 0)
+		return -1;
+	// Compaction would move the data under the maps
+	if(db->mapped == 0 && db->garbage >= REG_COMPACT_MIN && db->garbage*2 > db->end)
+		return reg_compact(db);
+	return 0;
+}
+
+int reg_db_compact(reg_db* db)
+{
+	if(reg_flush(db) != 0 || db->mapped > 0)
+		return -1;
+	return reg_compact(db);
+}
+
+int reg_db_writer_open(reg_db* db, reg_writer* w, const char* key, size_t size)
+{
+	struct reg_record r;
+	if(db->file == NULL || db->writer != NULL || strlen(key) > 255 || reg_flush(db) != 0)
+		return -1;
+	w->key = malloc(strlen(key)+1);
+	if(w->key == NULL)
+		return -1;
+	strcpy(w->key, key);
+	r.flags = 0;
+	r.key_len = strlen(key);
+	r.reserved = 0;
+	r.size = size;
+	// The record is written past the end, it only becomes part of the file when closed
+	if(fseek(db->file, db->end, SEEK_SET) != 0
+		|| fwrite(&r, REG_RECORD_SIZE, 1, db->file) != 1
+		|| fwrite(key, 1, r.key_len, db->file) != (size_t)r.key_len)
+	{
+		free(w->key);
+		return -1;
+	}
+	w->db = db;
+	w->offset = db->end;
+	w->pos = 0;
+	w->size = size;
+	db->writer = w;
+	return 0;
+}
+
+int reg_writer_write(reg_writer* w, const void* data, size_t len)
+{
+	FILE* file = w->db->file;
+	if(len > w->size-w->pos
+		|| fseek(file, w->offset+REG_RECORD_SIZE+strlen(w->key)+w->pos, SEEK_SET) != 0
+		|| fwrite(data, 1, len, file) != len)
+		return -1;
+	w->pos += len;
+	return 0;
+}
+
+int reg_writer_close(reg_writer* w)
+{
+	reg_db* db = w->db;
+	reg_entry* e;
+	int result = -1;
+	db->writer = NULL;
+	if(w->pos == w->size && fflush(db->file) == 0 && (e = reg_insert(db, w->key)) != NULL)
+	{
+		// The new record replaces whatever the key had, even in the cache
+		if(e->offset != REG_EMPTY)
+			db->garbage += reg_record_size(e);
+		free(e->cache);
+		e->cache = NULL;
+		e->cache_size = 0;
+		e->offset = w->offset;
+		e->size = w->size;
+		e->length = w->size;
+		e->state = 0;
+		db->end = w->offset+reg_record_size(e);
+		nio_trace(NIO_TRACE_REG_WRITE, e->hash, w->size);
+		result = reg_write_bounds(db) ? 0 : -1;
+	}
+	free(w->key);
+	w->key = NULL;
+	// Write the changes held back while the record was open
+	if(reg_flush(db) != 0)
+		result = -1;
+	return result;
+}
+
+void reg_writer_abort(reg_writer* w)
+{
+	w->db->writer = NULL;
+	free(w->key);
+	w->key = NULL;
+	reg_flush(w->db);
+}
+
+static int reg_compare_offsets(const void* a, const void* b)
+{
+	unsigned x = (*(reg_entry* const*)a)->offset;
+	unsigned y = (*(reg_entry* const*)b)->offset;
+	return x < y ? -1 : x > y;
+}
+
+// Copies part of the file to another place, the two must not overlap.
+static BOOL reg_copy(reg_db* db, unsigned from, unsigned to, unsigned len)
+{
+	unsigned char buf[256];
+	unsigned done = 0;
+	while(done < len)
+	{
+		unsigned chunk = len-done < sizeof(buf) ? len-done : sizeof(buf);
+		if(fseek(db->file, from+done, SEEK_SET) != 0
+			|| fread(buf, 1, chunk, db->file) != chunk
+			|| fseek(db->file, to+done, SEEK_SET) != 0
+			|| fwrite(buf, 1, chunk, db->file) != chunk)
+			return FALSE;
+		done += chunk;
+	}
+	return TRUE;
+}
+
+/* Compaction never writes over the records the header points to, so the
+ * file is whole wherever it stops. The live records are copied one after
+ * another past the end, and one header write makes the copy the records
+ * of the file. The copy is then moved down to the header, which the next
+ * header write switches to. The file needs room for the copy, which is
+ * given back on Linux once the records are at the start again.
+ */
+static int reg_compact(reg_db* db)
+{
+	reg_entry** live;
+	reg_entry* old;
+	int old_capacity;
+	unsigned old_start = db->start, old_end = db->end;
+	unsigned copy = db->end, pos = db->end, shift;
+	int n = 0, keep = 0, i;
+	if(db->garbage == 0 || db->writer != NULL)
+		return 0;
+	live = malloc(db->count*sizeof(reg_entry*));
+	if(live == NULL)
+		return -1;
+	for(i = 0; i < db->capacity; i++)
+	{
+		if(db->entries[i].key != NULL && db->entries[i].offset != REG_EMPTY)
+			live[n++] = &db->entries[i];
+	}
+	qsort(live, n, sizeof(reg_entry*), reg_compare_offsets);
+	
+	// Nothing points to the copy until the header does
+	for(i = 0; i < n; i++)
+	{
+		unsigned len = reg_record_size(live[i]);
+		if(!reg_copy(db, live[i]->offset, pos, len))
+		{
+			free(live);
+			return -1;
+		}
+		pos += len;
+	}
+	db->start = copy;
+	db->end = pos;
+	if(fflush(db->file) != 0 || !reg_write_bounds(db))
+	{
+		db->start = old_start;
+		db->end = old_end;
+		free(live);
+		return -1;
+	}
+	for(i = 0, pos = copy; i < n; i++)
+	{
+		live[i]->offset = pos;
+		pos += reg_record_size(live[i]);
+	}
+	free(live);
+	db->garbage = copy-REG_HEADER_SIZE;
+	
+	// The records left before the copy are garbage, the copy can go over them
+	shift = copy-REG_HEADER_SIZE;
+	if(!reg_copy(db, copy, REG_HEADER_SIZE, db->end-copy) || fflush(db->file) != 0)
+		return -1;
+	db->start = REG_HEADER_SIZE;
+	db->end -= shift;
+	if(!reg_write_bounds(db))
+	{
+		db->start = copy;
+		db->end += shift;
+		return -1;
+	}
+	for(i = 0; i < db->capacity; i++)
+	{
+		if(db->entries[i].key != NULL && db->entries[i].offset != REG_EMPTY)
+			db->entries[i].offset -= shift;
+	}
+	db->garbage = 0;
+#if defined(__linux__)
+	// Past the end is never read, so the file is whole even if this fails
+	if(ftruncate(fileno(db->file), db->end) != 0)
+		clearerr(db->file);
+#endif
+	
+	// Drop the deleted keys from the index. The new one is sized for all
+	// the keys that stay, so it never has to grow halfway.
+	old = db->entries;
+	old_capacity = db->capacity;
+	for(i = 0; i < old_capacity; i++)
+	{
+		if(old[i].key != NULL && (old[i].offset != REG_EMPTY || (old[i].state & REG_CACHED)))
+			keep++;
+	}
+	db->capacity = 16;
+	while((keep+1)*4 > db->capacity*3)
+		db->capacity *= 2;
+	db->entries = calloc(db->capacity, sizeof(reg_entry));
+	if(db->entries == NULL)
+	{
+		// The old index still works, it only holds on to the deleted keys
+		db->entries = old;
+		db->capacity = old_capacity;
+		return 0;
+	}
+	db->count = 0;
+	for(i = 0; i < old_capacity; i++)
+	{
+		if(old[i].key == NULL)
+			continue;
+		if(old[i].offset == REG_EMPTY && !(old[i].state & REG_CACHED))
+			free(old[i].key);
+		else
+		{
+			*reg_find(db, old[i].key, old[i].hash) = old[i];
+			db->count++;
+		}
+	}
+	free(old);
+	return 0;
+}
+
+void reg_set_default(reg_db* db)
+{
+	reg_default = db;
+}
+
+static void reg_default_exit(void)
+{
+	reg_commit();
+}
+
+reg_db* reg_get_default(void)
+{
+	static BOOL hooked = FALSE;
+	if(reg_default == NULL && reg_open(&reg_default_db, REG_DEFAULT_PATH) == 0)
+		reg_default = &reg_default_db;
+	if(!hooked)
+	{
+		atexit(reg_default_exit);
+		hooked = TRUE;
+	}
+	return reg_default;
+}
+
+void reg_compression(const BOOL enable)
+{
+	reg_db* db = reg_get_default();
+	if(db != NULL)
+		reg_db_compression(db, enable);
+}
+
+int reg_commit(void)
+{
+	if(reg_default == NULL)
+		return 0;
+	return reg_db_commit(reg_default);
+}
+
+int reg_store(void* dataptr, size_t size, char* regpath)
+{
+	reg_db* db = reg_get_default();
+	if(db == NULL)
+		return -1;
+	return reg_db_store(db, regpath, dataptr, size);
+}
+
+// Reads a whole plain file, as written by older versions of reg_store().
+static void* reg_read_file(const char* path, size_t* size)
+{
+	FILE* file = fopen(path, "rb");
+	void* result = NULL;
+	long length;
 	if(file == NULL)
 		return NULL;
-	fread(result,1,fstat.st_size,file);
+	// There is no stat, so the size is found by seeking to the end
+	if(fseek(file, 0, SEEK_END) == 0 && (length = ftell(file)) >= 0 && fseek(file, 0, SEEK_SET) == 0)
+	{
+		result = malloc(length ? length : 1);
+		if(result != NULL && fread(result, 1, length, file) != (size_t)length)
+		{
+			free(result);
+			result = NULL;
+		}
+		if(result != NULL && size != NULL)
+			*size = length;
+	}
 	fclose(file);
-	
 	return result;
-*/	return NULL;
+}
+
+void* reg_read(char* regpath, size_t* size)
+{
+	reg_db* db = reg_get_default();
+	void* result = db != NULL ? reg_db_get(db, regpath, size) : NULL;
+	if(result == NULL)
+		result = reg_read_file(regpath, size);
+	return result;
+}
+
+void* reg_get(char* regpath)
+{
+	return reg_read(regpath, NULL);
+}
+
+const void* reg_map(char* regpath, size_t* size)
+{
+	reg_db* db = reg_get_default();
+	if(db == NULL)
+		return NULL;
+	return reg_db_map(db, regpath, size);
+}
+
+void reg_unmap(const void* ptr)
+{
+	if(reg_default != NULL)
+		reg_db_unmap(reg_default, ptr);
 }
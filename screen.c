@@ -29,105 +29,265 @@
 #include <string.h>
 #include <fxcg/display.h>
 #include "charmap.h"
+#include "palette.h"
 #include "prizmio.h"
 
+#ifdef PRIZMIO_HOST
+#define VRAM (unsigned short*)GetVRAMAddress();
+#else
 #define VRAM (unsigned short*)0xA8000000;
+#endif
+
+static int present_policy = NIO_PRESENT_END_OF_CALL;
+static int present_depth = 0;
+// Rows of the VRAM that changed since the last present
+static int touched_top = LCD_HEIGHT_PX;
+static int touched_bottom = -1;
+
+#ifdef NIO_STATS
+nio_stats nio_stats_screen;
+#endif
+
+void nio_stats_get(const nio_console* c, nio_stats* s)
+{
+#ifdef NIO_STATS
+	*s = c != NULL ? c->stats : nio_stats_screen;
+#else
+	memset(s, 0, sizeof(nio_stats));
+#endif
+}
+
+void nio_stats_reset(nio_console* c)
+{
+#ifdef NIO_STATS
+	memset(c != NULL ? &c->stats : &nio_stats_screen, 0, sizeof(nio_stats));
+#endif
+}
+
+void nio_vram_touch(int y1, int y2)
+{
+	if(y1 < 0) y1 = 0;
+	if(y2 >= LCD_HEIGHT_PX) y2 = LCD_HEIGHT_PX-1;
+	if(y1 > y2)
+		return;
+	if(y1 < touched_top) touched_top = y1;
+	if(y2 > touched_bottom) touched_bottom = y2;
+}
+
+void nio_present(void)
+{
+	unsigned start;
+	if(touched_top > touched_bottom)
+		return;
+	start = nio_trace_begin();
+	if(touched_top == 0 && touched_bottom == LCD_HEIGHT_PX-1)
+	{
+		Bdisp_PutDisp_DD();
+		NIO_STAT(presents_full, 1);
+	}
+	else
+	{
+		Bdisp_PutDisp_DD_stripe(touched_top, touched_bottom);
+		NIO_STAT(presents_partial, 1);
+	}
+	nio_trace_end(NIO_TRACE_PRESENT, touched_top, touched_bottom, start);
+	touched_top = LCD_HEIGHT_PX;
+	touched_bottom = -1;
+}
+
+void nio_present_policy(const int policy)
+{
+	present_policy = policy;
+	if(policy != NIO_PRESENT_EXPLICIT)
+		nio_present();
+}
+
+int nio_present_get_policy(void)
+{
+	return present_policy;
+}
+
+void nio_present_hold(void)
+{
+	present_depth++;
+}
+
+void nio_present_release(void)
+{
+	if(present_depth > 0)
+		present_depth--;
+	if(present_policy == NIO_PRESENT_IMMEDIATE || (present_policy == NIO_PRESENT_END_OF_CALL && present_depth == 0))
+		nio_present();
+}
 
 unsigned short getPaletteColor(unsigned int color)
 {
-	unsigned short palette[16] = {0x0000, 0xa800, 0x0540, 0xaaa0, 0x0015, 0xa815, 0x0555, 0xad55,
-					0x5aab, 0xfaab, 0x5feb, 0xffeb, 0x5abf, 0xfabf, 0x5fff, 0xffff};
-	int rbtable[6] = {0,6,12,18,24,31};
-	int gtable[6] = {0,12,25,37,50,63};
-        unsigned int c = color;
-        unsigned int d;
-        if(c < 16)
-        {
-                return palette[c];
-        }
-        else if(c < 232)
-        {
-                d = c-16;
-                return (rbtable[d/36]<<11)+(gtable[(d/6)%6]<<5)+rbtable[d%6];
-        }
-        else if(c < 256)
-        {
-                d = c-232;
-                return ((d+1)<<11)+((d*2+2)<<5)+(d+1);
-        }
+	if(color < 256)
+		return nio_default_palette[color];
 	return 0;
 }
 
-void nio_pixel_set(int x, int y, unsigned int color)
+void nio_rgb_pixel_set(int x, int y, unsigned short color)
 {
 	unsigned short *scr = VRAM;
 	if(x >= 0 && x < LCD_WIDTH_PX && y >= 0 && y < LCD_HEIGHT_PX)
 	{
-		scr[y*LCD_WIDTH_PX+x] = getPaletteColor(color);
-		Bdisp_SetPoint_DD(x, y, getPaletteColor(color));
+		nio_present_hold();
+		scr[y*LCD_WIDTH_PX+x] = color;
+		nio_vram_touch(y, y);
+		NIO_STAT(pixels, 1);
+		NIO_STAT(dd_pixels, 1);
+		nio_present_release();
 	}
 }
 
-void nio_vram_pixel_set(int x, int y, unsigned int color)
+void nio_vram_rgb_pixel_set(int x, int y, unsigned short color)
 {
 	unsigned short *scr = VRAM;
 	if(x >= 0 && x < LCD_WIDTH_PX && y >= 0 && y < LCD_HEIGHT_PX)
 	{
-		scr[y*LCD_WIDTH_PX+x] = getPaletteColor(color);
+		scr[y*LCD_WIDTH_PX+x] = color;
+		nio_vram_touch(y, y);
+		NIO_STAT(pixels, 1);
 	}
 }
 
-void nio_pixel_putc(int x, int y, char ch, int bgColor, int textColor)
+void nio_pixel_set(int x, int y, unsigned int color)
+{
+	nio_rgb_pixel_set(x, y, getPaletteColor(color));
+}
+
+void nio_vram_pixel_set(int x, int y, unsigned int color)
+{
+	nio_vram_rgb_pixel_set(x, y, getPaletteColor(color));
+}
+
+void nio_vram_move_up(int x, int y, int w, int h, int dy)
+{
+	unsigned short *scr = VRAM;
+	int row;
+	if(dy <= 0 || dy >= h)
+		return;
+	nio_vram_touch(y, y+h-dy-1);
+	NIO_STAT(pixels, (h-dy)*w);
+	scr += y*LCD_WIDTH_PX+x;
+	// Full-width rectangles are contiguous and move as one block
+	if(x == 0 && w == LCD_WIDTH_PX)
+	{
+		memmove(scr, scr+dy*LCD_WIDTH_PX, (h-dy)*LCD_WIDTH_PX*sizeof(unsigned short));
+		return;
+	}
+	for(row = 0; row < h-dy; row++, scr += LCD_WIDTH_PX)
+		memcpy(scr, scr+dy*LCD_WIDTH_PX, w*sizeof(unsigned short));
+}
+
+void nio_vram_fill(int x, int y, int w, int h, unsigned short color)
+{
+	unsigned short *scr = VRAM;
+	int row, col;
+	if(x < 0) { w += x; x = 0; }
+	if(y < 0) { h += y; y = 0; }
+	if(x+w > LCD_WIDTH_PX) w = LCD_WIDTH_PX-x;
+	if(y+h > LCD_HEIGHT_PX) h = LCD_HEIGHT_PX-y;
+	if(w <= 0 || h <= 0)
+		return;
+	nio_vram_touch(y, y+h-1);
+	NIO_STAT(pixels, w*h);
+	scr += y*LCD_WIDTH_PX+x;
+	for(row = 0; row < h; row++, scr += LCD_WIDTH_PX)
+		for(col = 0; col < w; col++)
+			scr[col] = color;
+}
+
+void nio_glyph_putc(int x, int y, char ch, unsigned short bg, unsigned short fg)
+{
+#ifdef NIO_STATS
+	unsigned long pixels = nio_stats_screen.pixels;
+#endif
+	nio_present_hold();
+	nio_vram_glyph_putc(x, y, ch, bg, fg);
+	NIO_STAT(dd_pixels, nio_stats_screen.pixels-pixels);
+	nio_present_release();
+}
+void nio_vram_glyph_putc(int x, int y, char ch, unsigned short bg, unsigned short fg)
 {
-	int i, j, pixelOn;
-	for(i = 0; i < NIO_CHAR_WIDTH; i++)
+	unsigned short *scr = VRAM;
+	const char* glyph = MBCharSet8x6_definition[(unsigned char)ch];
+	int left = 0, right = NIO_CHAR_WIDTH;
+	int top = 0, bottom = NIO_CHAR_HEIGHT;
+	int row, col, mask;
+	
+	// Clip the whole glyph once instead of every pixel
+	if(x < 0) left = -x;
+	if(x+right > LCD_WIDTH_PX) right = LCD_WIDTH_PX-x;
+	if(y < 0) top = -y;
+	if(y+bottom > LCD_HEIGHT_PX) bottom = LCD_HEIGHT_PX-y;
+	if(left >= right || top >= bottom)
+		return;
+	nio_vram_touch(y+top, y+bottom-1);
+	NIO_STAT(glyphs, 1);
+	NIO_STAT(pixels, (bottom-top)*(right-left));
+	
+	// The font is stored column by column with bit n being row n+1,
+	// so the top row is always background. Write it row by row.
+	scr += (y+top)*LCD_WIDTH_PX+x;
+	for(row = top; row < bottom; row++, scr += LCD_WIDTH_PX)
 	{
-		for(j = NIO_CHAR_HEIGHT; j > 0; j--)
+		mask = row == 0 ? 0 : 1 << (row-1);
+		if(left == 0 && right == NIO_CHAR_WIDTH)
+		{
+			scr[0] = glyph[0] & mask ? fg : bg;
+			scr[1] = glyph[1] & mask ? fg : bg;
+			scr[2] = glyph[2] & mask ? fg : bg;
+			scr[3] = glyph[3] & mask ? fg : bg;
+			scr[4] = glyph[4] & mask ? fg : bg;
+			scr[5] = glyph[5] & mask ? fg : bg;
+		}
+		else
 		{
-			pixelOn = MBCharSet8x6_definition[(unsigned char)ch][i] << j ;
-			pixelOn = pixelOn & 0x80 ;
-			if (pixelOn) 		nio_pixel_set(x+i,y+NIO_CHAR_HEIGHT-j,textColor);
-			else if(!pixelOn) 	nio_pixel_set(x+i,y+NIO_CHAR_HEIGHT-j,bgColor);
+			for(col = left; col < right; col++)
+				scr[col] = glyph[col] & mask ? fg : bg;
 		}
 	}
 }
-void nio_pixel_puts(int x, int y, char* str, int bgColor, int textColor)
+
+void nio_pixel_putc(int x, int y, char ch, int bgColor, int textColor)
+{
+	nio_glyph_putc(x, y, ch, getPaletteColor(bgColor), getPaletteColor(textColor));
+}
+void nio_pixel_puts(int x, int y, const char* str, int bgColor, int textColor)
 {
 	int l = strlen(str);
 	int i;
 	int stop=0;
+	unsigned short bg = getPaletteColor(bgColor);
+	unsigned short fg = getPaletteColor(textColor);
+	nio_present_hold();
 	for (i = 0; i < l && !stop; i++)
 	{
-		nio_pixel_putc(x, y, str[i], bgColor, textColor);
+		nio_glyph_putc(x, y, str[i], bg, fg);
 		x += NIO_CHAR_WIDTH;
 		if (x >= LCD_WIDTH_PX-NIO_CHAR_WIDTH)
 		{
 			stop=1;
 		}
 	}
+	nio_present_release();
 }
 void nio_vram_pixel_putc(int x, int y, char ch, int bgColor, int textColor)
 {
-	int i, j, pixelOn;
-	for(i = 0; i < NIO_CHAR_WIDTH; i++)
-	{
-		for(j = NIO_CHAR_HEIGHT; j > 0; j--)
-		{
-			pixelOn = MBCharSet8x6_definition[(unsigned char)ch][i] << j ;
-			pixelOn = pixelOn & 0x80 ;
-			if (pixelOn) 		nio_vram_pixel_set(x+i,y+NIO_CHAR_HEIGHT-j,textColor);
-			else if(!pixelOn) 	nio_vram_pixel_set(x+i,y+NIO_CHAR_HEIGHT-j,bgColor);
-		}
-	}
+	nio_vram_glyph_putc(x, y, ch, getPaletteColor(bgColor), getPaletteColor(textColor));
 }
-void nio_vram_pixel_puts(int x, int y, char* str, int bgColor, int textColor)
+void nio_vram_pixel_puts(int x, int y, const char* str, int bgColor, int textColor)
 {
 	int l = strlen(str);
 	int i;
 	int stop=0;
+	unsigned short bg = getPaletteColor(bgColor);
+	unsigned short fg = getPaletteColor(textColor);
 	for (i = 0; i < l && !stop; i++)
 	{
-		nio_vram_pixel_putc(x, y, str[i], bgColor, textColor);
+		nio_vram_glyph_putc(x, y, str[i], bg, fg);
 		x += NIO_CHAR_WIDTH;
 		if (x >= LCD_WIDTH_PX-NIO_CHAR_WIDTH)
 		{
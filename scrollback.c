@@ -0,0 +1,214 @@
+/**
+ * @file scrollback.c
+ * @author  Julien "Juju" Savard <juju2143@gmail.com>
+ * @author  Julian Mackeben aka compu <compujuckel@googlemail.com>
+ * @version 0.1
+ *
+ * @section LICENSE
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301  USA
+ *
+ * @section DESCRIPTION
+ *
+ * Scrollback history of consoles
+ *
+ * Lines scrolled off a console are stored in a ring of bytes, oldest
+ * first. Each line is stored as
+ *   length (2 bytes), chars count, runs count, chars, runs, fill color, length (2 bytes)
+ * where trailing blank cells are trimmed, a run is a count followed by a
+ * color, and the fill color is used for the trimmed cells. The length
+ * is repeated at the end so the ring can be walked backwards.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include "prizmio.h"
+
+// The chars count of a line is a byte
+#define SB_MAX_COLS 255
+
+static inline size_t sb_wrap(const nio_scrollback* sb, size_t pos)
+{
+	return pos >= sb->size ? pos-sb->size : pos;
+}
+
+static inline unsigned char sb_get(const nio_scrollback* sb, size_t pos)
+{
+	return sb->buffer[sb_wrap(sb,pos)];
+}
+
+static void sb_put(nio_scrollback* sb, const unsigned char* src, size_t len)
+{
+	size_t first = sb->size-sb->head;
+	if(first > len)
+		first = len;
+	memcpy(sb->buffer+sb->head, src, first);
+	memcpy(sb->buffer, src+first, len-first);
+	sb->head = sb_wrap(sb, sb->head+len);
+	sb->used += len;
+}
+
+static void sb_drop_oldest(nio_scrollback* sb)
+{
+	size_t tail = sb_wrap(sb, sb->head+sb->size-sb->used);
+	size_t len = (sb_get(sb,tail) << 8) | sb_get(sb,tail+1);
+	sb->used -= len+4;
+	sb->lines--;
+}
+
+int nio_scrollback_enable(nio_console* c, size_t budget)
+{
+	size_t cells = c->max_x*c->max_y;
+	nio_scrollback* sb;
+	nio_scrollback_disable(c);
+	if(c->max_x > SB_MAX_COLS)
+		return -1;
+	// The view buffers and the history share one allocation
+	sb = malloc(sizeof(nio_scrollback)+cells*(sizeof(unsigned short)+sizeof(char))+budget);
+	if(sb == NULL)
+		return -1;
+	sb->view_color = (unsigned short*)(sb+1);
+	sb->view_data = (char*)(sb->view_color+cells);
+	sb->buffer = (unsigned char*)(sb->view_data+cells);
+	sb->size = budget;
+	sb->head = 0;
+	sb->used = 0;
+	sb->lines = 0;
+	sb->view_offset = 0;
+	c->scrollback = sb;
+	return 0;
+}
+
+void nio_scrollback_disable(nio_console* c)
+{
+	if(c->scrollback == NULL)
+		return;
+	if(c->scrollback->view_offset)
+		nio_invalidate(c);
+	free(c->scrollback);
+	c->scrollback = NULL;
+}
+
+void nio_scrollback_push(nio_console* c, const char* data, const unsigned short* color)
+{
+	nio_scrollback* sb = c->scrollback;
+	unsigned char line[2+2+SB_MAX_COLS+SB_MAX_COLS*3+2+2];
+	unsigned short fill = color[c->max_x-1];
+	int chars = c->max_x;
+	int runs = 0;
+	int i, len;
+	unsigned char* p;
+
+	// Trim the trailing blank cells that have the same color as the last one
+	while(chars > 0 && (data[chars-1] == 0 || data[chars-1] == ' ') && color[chars-1] == fill)
+		chars--;
+
+	p = line+4;
+	memcpy(p, data, chars);
+	p += chars;
+	for(i = 0; i < chars; runs++)
+	{
+		int start = i;
+		while(i < chars && i-start < 255 && color[i] == color[start])
+			i++;
+		*p++ = i-start;
+		*p++ = color[start] >> 8;
+		*p++ = color[start] & 0xFF;
+	}
+	*p++ = fill >> 8;
+	*p++ = fill & 0xFF;
+	line[2] = chars;
+	line[3] = runs;
+	len = p-line-2;
+	line[0] = len >> 8;
+	line[1] = len & 0xFF;
+	*p++ = len >> 8;
+	*p++ = len & 0xFF;
+
+	if((size_t)(len+4) > sb->size)
+		return;
+	while(sb->used+len+4 > sb->size)
+		sb_drop_oldest(sb);
+	sb_put(sb, line, len+4);
+	sb->lines++;
+}
+
+// Decodes the line starting at pos into a row of cells.
+static void sb_decode(const nio_scrollback* sb, size_t pos, int max_x, char* data, unsigned short* color)
+{
+	int chars = sb_get(sb,pos+2);
+	int runs = sb_get(sb,pos+3);
+	size_t p = pos+4;
+	unsigned short fill;
+	int i, x = 0;
+	for(i = 0; i < chars; i++)
+		data[i] = sb_get(sb,p++);
+	for(i = 0; i < runs; i++)
+	{
+		int count = sb_get(sb,p);
+		unsigned short c = (sb_get(sb,p+1) << 8) | sb_get(sb,p+2);
+		p += 3;
+		while(count-- > 0)
+			color[x++] = c;
+	}
+	fill = (sb_get(sb,p) << 8) | sb_get(sb,p+1);
+	for(; x < max_x; x++)
+	{
+		data[x] = 0;
+		color[x] = fill;
+	}
+}
+
+void nio_scrollback_view(nio_console* c, int offset)
+{
+	nio_scrollback* sb = c->scrollback;
+	size_t pos;
+	int shown, i;
+	if(sb == NULL)
+		return;
+	if(offset > sb->lines)
+		offset = sb->lines;
+	if(offset < 0)
+		offset = 0;
+	if(offset == sb->view_offset)
+		return;
+	sb->view_offset = offset;
+
+	// Walk back from the newest line to the ones shown at the top
+	shown = offset < c->max_y ? offset : c->max_y;
+	pos = sb->head;
+	for(i = 0; i < offset-shown; i++)
+		pos = sb_wrap(sb, pos+sb->size-(((sb_get(sb,pos+sb->size-2) << 8) | sb_get(sb,pos+sb->size-1))+4));
+	for(i = shown-1; i >= 0; i--)
+	{
+		pos = sb_wrap(sb, pos+sb->size-(((sb_get(sb,pos+sb->size-2) << 8) | sb_get(sb,pos+sb->size-1))+4));
+		sb_decode(sb, pos, c->max_x, sb->view_data+i*c->max_x, sb->view_color+i*c->max_x);
+	}
+
+	nio_invalidate(c);
+	if(c->drawing_enabled)
+		nio_fflush(c);
+}
+
+void nio_scrollback_scroll(nio_console* c, int lines)
+{
+	if(c->scrollback != NULL)
+		nio_scrollback_view(c, c->scrollback->view_offset+lines);
+}
+
+int nio_scrollback_lines(const nio_console* c)
+{
+	return c->scrollback != NULL ? c->scrollback->lines : 0;
+}
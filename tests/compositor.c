@@ -0,0 +1,181 @@
+/**
+ * @file compositor.c
+ * @author  Julien "Juju" Savard <juju2143@gmail.com>
+ * @version 0.1
+ *
+ * @section LICENSE
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301  USA
+ *
+ * @section DESCRIPTION
+ *
+ * Test of the compositor on the host build: after each frame the VRAM must
+ * be what drawing every visible console from the bottom up gives.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fxcg/display.h>
+#include <prizmio.h>
+#include <prizmio_host.h>
+
+#define CONSOLES 4
+#define PIXELS (LCD_WIDTH_PX*LCD_HEIGHT_PX)
+
+static nio_console consoles[CONSOLES];
+static nio_compositor comp;
+static unsigned short expected[PIXELS];
+static unsigned short saved[PIXELS];
+
+// Paints the visible consoles bottom up into expected, the VRAM is kept as it was
+static void paint_expected(void)
+{
+	unsigned short* vram = GetVRAMAddress();
+	int i, x, y;
+	memcpy(saved, vram, sizeof(saved));
+	for(i = 0; i < PIXELS; i++)
+		vram[i] = comp.background;
+	for(i = 0; i < comp.count; i++)
+	{
+		nio_console* c = comp.consoles[i];
+		if(!comp.visible[i])
+			continue;
+		for(y = 0; y < c->max_y; y++)
+			for(x = 0; x < c->max_x; x++)
+				nio_vram_csl_drawchar(c, x, y);
+	}
+	memcpy(expected, vram, sizeof(expected));
+	memcpy(vram, saved, sizeof(saved));
+}
+
+// Draws a frame, returns the number of pixels that differ from what is expected
+static int check_frame(void)
+{
+	unsigned short* vram = GetVRAMAddress();
+	int i, wrong = 0;
+	nio_compositor_frame(&comp);
+	paint_expected();
+	for(i = 0; i < PIXELS; i++)
+		if(vram[i] != expected[i])
+			wrong++;
+	return wrong;
+}
+
+static void setup(void)
+{
+	static const int geometry[CONSOLES][4] = {{0, 0, 64, 27}, {5, 3, 30, 10}, {20, 8, 40, 12}, {-3, 20, 20, 6}};
+	unsigned short* vram = GetVRAMAddress();
+	int i;
+	nio_compositor_init(&comp, NIO_COLOR_BLUE);
+	for(i = 0; i < PIXELS; i++)
+		vram[i] = comp.background;
+	for(i = 0; i < CONSOLES; i++)
+	{
+		nio_init(&consoles[i], geometry[i][2], geometry[i][3], geometry[i][0]*NIO_CHAR_WIDTH, geometry[i][1]*NIO_CHAR_HEIGHT, i, 15-i, FALSE);
+		nio_compositor_add(&comp, &consoles[i]);
+	}
+}
+
+static void teardown(void)
+{
+	int i;
+	for(i = CONSOLES-1; i >= 0; i--)
+	{
+		nio_compositor_remove(&comp, &consoles[i]);
+		nio_free(&consoles[i]);
+	}
+}
+
+// A hidden console that scrolls must not move the pixels of the one under it
+static int test_hidden_scroll(void)
+{
+	nio_console* under = &consoles[0];
+	nio_console* hidden = &consoles[1];
+	int i, wrong;
+	setup();
+	// Nothing over it, so it is only hidden
+	nio_compositor_raise(&comp, hidden);
+	for(i = 0; i < under->max_y; i++)
+		nio_fprintf(under, "line %d of the console under the hidden one\n", i);
+	for(i = 0; i < hidden->max_y; i++)
+		nio_fprintf(hidden, "hidden %d\n", i);
+	nio_compositor_frame(&comp);
+	nio_compositor_show(&comp, hidden, FALSE);
+	nio_compositor_frame(&comp);
+	for(i = 0; i < 5; i++)
+		nio_scroll(hidden);
+	wrong = check_frame();
+	teardown();
+	if(wrong)
+		printf("hidden scroll: %d pixels wrong\n", wrong);
+	return wrong != 0;
+}
+
+// Random writes, scrolls and z-order changes, with a frame now and then
+static int test_random(void)
+{
+	int step, fails = 0;
+	srand(1);
+	setup();
+	for(step = 0; step < 3000; step++)
+	{
+		nio_console* c = &consoles[rand()%CONSOLES];
+		int op = rand()%11;
+		if(op < 5)
+		{
+			char text[32];
+			snprintf(text, sizeof(text), "s%d%s", step, rand()%3 == 0 ? "\n" : " ");
+			nio_fputs(text, c);
+		}
+		else if(op == 5)
+			nio_compositor_raise(&comp, c);
+		else if(op == 6)
+			nio_compositor_lower(&comp, c);
+		else if(op == 7)
+			nio_compositor_show(&comp, c, rand()%2);
+		else if(op == 8)
+		{
+			nio_compositor_remove(&comp, c);
+			nio_compositor_add(&comp, c);
+		}
+		else if(op == 9)
+			nio_scroll(c);
+		else
+			nio_clear(c);
+		if(rand()%3 == 0)
+		{
+			int wrong;
+			host_present_reset();
+			wrong = check_frame();
+			if(host_presents > 1 || wrong)
+			{
+				if(fails++ < 5)
+					printf("random: step %d, %d pixels wrong, %d presents\n", step, wrong, host_presents);
+			}
+		}
+	}
+	teardown();
+	return fails != 0;
+}
+
+int main()
+{
+	int fails = 0;
+	fails += test_hidden_scroll();
+	fails += test_random();
+	printf("compositor: %s\n", fails ? "FAIL" : "ok");
+	return fails != 0;
+}
@@ -0,0 +1,234 @@
+/**
+ * @file transfer.c
+ * @author  Julien "Juju" Savard <juju2143@gmail.com>
+ * @version 0.1
+ *
+ * @section LICENSE
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301  USA
+ *
+ * @section DESCRIPTION
+ *
+ * Test of uart_send() and uart_receive_reg() on the host build, over pipes
+ * that damage some of the bytes going through them in both directions.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <prizmio.h>
+#include <prizmio_host.h>
+
+#define DATA_SIZE 8192
+#define TIME_LIMIT 30 // seconds for a transfer
+
+// Frames as in transfer.c
+#define XFER_MAGIC 0x5A
+#define XFER_START 1
+#define XFER_DATA  2
+#define XFER_END   3
+
+static unsigned char data[DATA_SIZE];
+static int pipes[4][2];
+
+// Closes the ends of the pipes a process does not use, so the others see the end of them
+static void close_others(const int keep_in, const int keep_out)
+{
+	int i, j;
+	for(i = 0; i < 4; i++)
+		for(j = 0; j < 2; j++)
+			if(pipes[i][j] != keep_in && pipes[i][j] != keep_out)
+				close(pipes[i][j]);
+}
+
+// Copies one pipe to another, flipping the bits of one byte in every rate on average
+static void damage(int in, int out, int rate, unsigned seed)
+{
+	unsigned char buf[256];
+	int n, i;
+	srand(seed);
+	while((n = read(in, buf, sizeof(buf))) > 0)
+	{
+		for(i = 0; i < n; i++)
+			if(rand()%rate == 0)
+				buf[i] ^= 1 << rand()%8;
+		if(write(out, buf, n) != n)
+			break;
+	}
+	_exit(0);
+}
+
+static int source_read(void* ctx, char* buf, int len)
+{
+	size_t* pos = ctx;
+	int n = DATA_SIZE-*pos < (size_t)len ? (int)(DATA_SIZE-*pos) : len;
+	memcpy(buf, data+*pos, n);
+	*pos += n;
+	return n;
+}
+
+// Runs a transfer through damaging pipes, returns 0 if the data came through whole
+static int test_transfer(int rate)
+{
+	int* to_relay = pipes[0];
+	int* from_relay = pipes[1];
+	int* back_relay = pipes[2];
+	int* back = pipes[3];
+	pid_t relay, back_pid, sender;
+	char path[64], key[32];
+	reg_db db;
+	size_t size;
+	unsigned char* got;
+	int status, result;
+	time_t start = time(NULL);
+
+	if(pipe(to_relay) || pipe(from_relay) || pipe(back_relay) || pipe(back))
+		return 1;
+	// Sender -> relay -> receiver, and the acknowledgements back the same way
+	if((relay = fork()) == 0)
+	{
+		close_others(to_relay[0], from_relay[1]);
+		damage(to_relay[0], from_relay[1], rate, 1);
+	}
+	if((back_pid = fork()) == 0)
+	{
+		close_others(back_relay[0], back[1]);
+		damage(back_relay[0], back[1], rate, 2);
+	}
+	if((sender = fork()) == 0)
+	{
+		size_t pos = 0;
+		close_others(back[0], to_relay[1]);
+		alarm(TIME_LIMIT);
+		host_serial_fds(back[0], to_relay[1]);
+		uart_open(115200);
+		_exit(uart_send("test", DATA_SIZE, source_read, &pos) == 0 ? 0 : 1);
+	}
+	close_others(from_relay[0], back_relay[1]);
+
+	snprintf(path, sizeof(path), "/tmp/prizmio-test-%d.reg", (int)getpid());
+	remove(path);
+	alarm(TIME_LIMIT);
+	host_serial_fds(from_relay[0], back_relay[1]);
+	uart_open(115200);
+	result = reg_open(&db, path) != 0 || uart_receive_reg(&db, key, sizeof(key)) != 0;
+	alarm(0);
+	if(result == 0)
+	{
+		got = reg_db_get(&db, key, &size);
+		result = strcmp(key, "test") != 0 || got == NULL || size != DATA_SIZE || memcmp(got, data, DATA_SIZE) != 0;
+		free(got);
+	}
+	reg_close(&db);
+	remove(path);
+
+	close(from_relay[0]);
+	close(back_relay[1]);
+	waitpid(sender, &status, 0);
+	if(!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+		result = 1;
+	waitpid(relay, NULL, 0);
+	waitpid(back_pid, NULL, 0);
+	printf("transfer, 1 byte in %d damaged: %s in %ld s\n", rate, result ? "FAIL" : "ok", (long)(time(NULL)-start));
+	fflush(stdout);
+	return result;
+}
+
+// Writes a frame to a buffer, returns its size
+static int frame(unsigned char* out, const int type, const int seq, const unsigned char* payload, const int len)
+{
+	unsigned crc;
+	out[0] = XFER_MAGIC;
+	out[1] = type;
+	out[2] = seq;
+	out[3] = len >> 8;
+	out[4] = len;
+	memcpy(out+5, payload, len);
+	crc = nio_crc32(0, out+1, 4+len);
+	out[5+len] = crc >> 24;
+	out[6+len] = crc >> 16;
+	out[7+len] = crc >> 8;
+	out[8+len] = crc;
+	return 9+len;
+}
+
+// A frame whose length got bigger takes in the start of the next one, which must still be found
+static int test_resync(void)
+{
+	static unsigned char stream[1024];
+	unsigned char payload[100];
+	int in[2], out, size = 0, result;
+	reg_db db;
+	char path[64], key[32];
+	unsigned char* got;
+	size_t got_size;
+	time_t start = time(NULL);
+
+	// No 0x5A in the data, so the next frame is the only place to resume
+	memset(payload, 'p', sizeof(payload));
+	payload[0] = 0;
+	payload[1] = 0;
+	payload[2] = 0;
+	payload[3] = sizeof(payload);
+	memcpy(payload+4, "test", 4);
+	size += frame(stream+size, XFER_START, 0, payload, 8);
+	memset(payload, 'p', sizeof(payload));
+	size += frame(stream+size, XFER_DATA, 1, payload, sizeof(payload));
+	stream[size-sizeof(payload)-5] = 110; // length of the frame just written, 10 bytes too many
+	size += frame(stream+size, XFER_DATA, 1, payload, sizeof(payload)); // sent again
+	size += frame(stream+size, XFER_END, 2, NULL, 0);
+
+	if(pipe(in) || write(in[1], stream, size) != size)
+		return 1;
+	close(in[1]);
+	out = open("/dev/null", O_WRONLY);
+	snprintf(path, sizeof(path), "/tmp/prizmio-test-%d.reg", (int)getpid());
+	remove(path);
+	host_serial_fds(in[0], out);
+	uart_open(115200);
+	result = reg_open(&db, path) != 0 || uart_receive_reg(&db, key, sizeof(key)) != 0;
+	if(result == 0)
+	{
+		got = reg_db_get(&db, key, &got_size);
+		result = got == NULL || got_size != sizeof(payload) || memcmp(got, payload, sizeof(payload)) != 0;
+		free(got);
+	}
+	reg_close(&db);
+	remove(path);
+	close(in[0]);
+	close(out);
+	printf("transfer, frame with a bad length: %s in %ld s\n", result ? "FAIL" : "ok", (long)(time(NULL)-start));
+	fflush(stdout);
+	return result;
+}
+
+int main()
+{
+	int i, fails = 0;
+	srand(3);
+	for(i = 0; i < DATA_SIZE; i++)
+		data[i] = rand();
+	signal(SIGPIPE, SIG_IGN);
+	fails += test_resync();
+	fails += test_transfer(1000);
+	fails += test_transfer(300);
+	printf("transfer: %s\n", fails ? "FAIL" : "ok");
+	return fails != 0;
+}
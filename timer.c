@@ -0,0 +1,204 @@
+/**
+ * @file timer.c
+ * @author  Julien "Juju" Savard <juju2143@gmail.com>
+ * @version 0.1
+ *
+ * @section LICENSE
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301  USA
+ *
+ * @section DESCRIPTION
+ *
+ * Time, high-resolution timer and profiling zones
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <fxcg/rtc.h>
+#include "prizmio.h"
+
+#ifdef PRIZMIO_HOST
+#include <time.h>
+#endif
+
+unsigned nio_time_get(void)
+{
+	// The RTC counts 128 ticks per second
+	return (unsigned)RTC_GetTicks()*125/16;
+}
+
+unsigned nio_time_since(const unsigned start)
+{
+	unsigned now = nio_time_get();
+	// The RTC goes back to 0 at midnight
+	if(now < start)
+		now += 24*60*60*1000u;
+	return now-start;
+}
+
+#ifdef PRIZMIO_HOST
+
+// Microseconds, so 32 bits wrap every 71 minutes rather than every 4 seconds
+unsigned nio_timer_ticks(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned)ts.tv_sec*1000000u + (unsigned)ts.tv_nsec/1000u;
+}
+
+unsigned nio_timer_hz(void)
+{
+	return 1000000u;
+}
+
+#else
+
+/* Channel 2 of the TMU of the SH7305 counts down from 0xFFFFFFFF at Pphi/4
+ * and reloads on underflow, so ~TCNT counts up and wraps like the RTC time.
+ * The rate depends on the clock settings, so it is measured against the RTC.
+ */
+#define TMU_TSTR (*(volatile unsigned char*)0xA4490004)
+#define TMU_TCOR2 (*(volatile unsigned*)0xA4490020)
+#define TMU_TCNT2 (*(volatile unsigned*)0xA4490024)
+#define TMU_TCR2 (*(volatile unsigned short*)0xA4490028)
+#define TMU_STR2 0x04
+
+static unsigned timer_hz = 0;
+
+unsigned nio_timer_ticks(void)
+{
+	if(!(TMU_TSTR & TMU_STR2))
+	{
+		TMU_TCR2 = 0; // Pphi/4, no interrupt
+		TMU_TCOR2 = 0xFFFFFFFF;
+		TMU_TCNT2 = 0xFFFFFFFF;
+		TMU_TSTR |= TMU_STR2;
+	}
+	return ~TMU_TCNT2;
+}
+
+unsigned nio_timer_hz(void)
+{
+	while(timer_hz == 0)
+	{
+		unsigned start, ticks;
+		int rtc, now;
+		nio_timer_ticks();
+		// Count over 16 RTC ticks (125 ms), from one tick edge to another
+		rtc = RTC_GetTicks();
+		while(RTC_GetTicks() == rtc);
+		start = nio_timer_ticks();
+		rtc = RTC_GetTicks();
+		while((now = RTC_GetTicks()) >= rtc && now-rtc < 16);
+		ticks = nio_timer_ticks()-start;
+		// The RTC goes back to 0 at midnight, count again if it did
+		if(now >= rtc)
+			timer_hz = ticks*8;
+	}
+	return timer_hz;
+}
+
+#endif
+
+unsigned long nio_timer_us(const unsigned ticks)
+{
+	return (unsigned long)((unsigned long long)ticks*1000000/nio_timer_hz());
+}
+
+static nio_prof_zone prof_zones[NIO_PROF_ZONES];
+static int prof_count = 0;
+
+int nio_prof_zone_get(const char* name)
+{
+	int i;
+	for(i = 0; i < prof_count; i++)
+	{
+		if(prof_zones[i].name == name || strcmp(prof_zones[i].name, name) == 0)
+			return i;
+	}
+	if(prof_count == NIO_PROF_ZONES)
+		return -1;
+	memset(&prof_zones[prof_count], 0, sizeof(nio_prof_zone));
+	prof_zones[prof_count].name = name;
+	return prof_count++;
+}
+
+void nio_prof_begin(const int zone)
+{
+	if(zone >= 0 && zone < prof_count)
+		prof_zones[zone].start = nio_timer_ticks();
+}
+
+void nio_prof_end(const int zone)
+{
+	unsigned now = nio_timer_ticks();
+	nio_prof_zone* z;
+	unsigned ticks;
+	if(zone < 0 || zone >= prof_count)
+		return;
+	z = &prof_zones[zone];
+	ticks = now-z->start;
+	if(z->count == 0 || ticks < z->min)
+		z->min = ticks;
+	if(ticks > z->max)
+		z->max = ticks;
+	z->total += ticks;
+	z->count++;
+}
+
+const nio_prof_zone* nio_prof_get(const int zone)
+{
+	if(zone < 0 || zone >= prof_count)
+		return NULL;
+	return &prof_zones[zone];
+}
+
+void nio_prof_reset(void)
+{
+	int i;
+	for(i = 0; i < prof_count; i++)
+	{
+		prof_zones[i].count = 0;
+		prof_zones[i].min = 0;
+		prof_zones[i].max = 0;
+		prof_zones[i].total = 0;
+	}
+}
+
+static void nio_prof_line(nio_console* c, const char* line)
+{
+	if(c != NULL)
+		nio_fputs(line, c);
+	else
+		uart_puts(line);
+}
+
+void nio_prof_dump(nio_console* c)
+{
+	char line[80];
+	int i;
+	nio_snprintf(line, sizeof(line), "%-16s %7s %8s %8s %8s\n", "zone", "count", "min us", "avg us", "max us");
+	nio_prof_line(c, line);
+	for(i = 0; i < prof_count; i++)
+	{
+		const nio_prof_zone* z = &prof_zones[i];
+		unsigned long avg = z->count ? (unsigned long)((unsigned long long)z->total*1000000/nio_timer_hz()/z->count) : 0;
+		nio_snprintf(line, sizeof(line), "%-16.16s %7lu %8lu %8lu %8lu\n", z->name, z->count,
+			nio_timer_us(z->min), avg, nio_timer_us(z->max));
+		nio_prof_line(c, line);
+	}
+	if(c == NULL)
+		uart_flush();
+}
@@ -0,0 +1,221 @@
+/**
+ * @file trace2json.c
+ * @author  Julien "Juju" Savard <juju2143@gmail.com>
+ * @version 0.1
+ *
+ * @section LICENSE
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301  USA
+ *
+ * @section DESCRIPTION
+ *
+ * Turns trace dumps of nio_trace_export() into a Chrome trace, to open in
+ * chrome://tracing or Perfetto. Runs on a computer:
+ *
+ *   trace2json [dump] > trace.json
+ *
+ * The input is searched for dumps, so it can be a capture of the serial port
+ * with other output around, or a registry file that has one stored with
+ * nio_trace_store(). Each dump becomes a process of its own.
+ *
+ * The timer of a dump wraps around every 2^32 ticks, 2^32/hz seconds with
+ * the rate of the dump (71 minutes on a computer). Events further apart
+ * than that come out closer than they were.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TRACE_HEADER_SIZE 16
+#define TRACE_EVENT_SIZE 16
+
+// Each track is a thread of the process of a dump, its tid is its index
+static const char* tracks[] = {NULL, "console", "screen", "keyboard", "registry", "uart", "user"};
+#define TRACKS (int)(sizeof(tracks)/sizeof(tracks[0]))
+#define TRACK_USER 6
+
+// Same numbers as the NIO_TRACE_* types of prizmio.h
+static const struct
+{
+	const char* name;
+	int track;
+	const char* a;
+	const char* b;
+} trace_types[] = {
+	{NULL,        0, NULL,    NULL},
+	{"scroll",    1, "moved", NULL},
+	{"flush",     1, "drawn", NULL},
+	{"present",   2, "y1",    "y2"},
+	{"key",       3, "event", "key"},
+	{"reg read",  4, "hash",  "bytes"},
+	{"reg write", 4, "hash",  "bytes"},
+	{"uart tx",   5, NULL,    "bytes"},
+	{"uart rx",   5, NULL,    "bytes"}
+};
+#define TRACE_TYPES (int)(sizeof(trace_types)/sizeof(trace_types[0]))
+#define TRACE_USER 0x100
+
+static unsigned be16(const unsigned char* p)
+{
+	return p[0] << 8 | p[1];
+}
+
+static unsigned be32(const unsigned char* p)
+{
+	return (unsigned)p[0] << 24 | p[1] << 16 | p[2] << 8 | p[3];
+}
+
+static unsigned char* read_all(FILE* f, size_t* size)
+{
+	size_t cap = 65536, len = 0;
+	unsigned char* buf = malloc(cap);
+	size_t n;
+	if(buf == NULL)
+		return NULL;
+	while((n = fread(buf+len, 1, cap-len, f)) > 0)
+	{
+		len += n;
+		if(len == cap)
+		{
+			unsigned char* bigger = realloc(buf, cap*2);
+			if(bigger == NULL)
+			{
+				free(buf);
+				return NULL;
+			}
+			buf = bigger;
+			cap *= 2;
+		}
+	}
+	*size = len;
+	return buf;
+}
+
+static void print_track(int* first, int pid, int tid, const char* name)
+{
+	printf("%s\n{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"%s\"}}", *first ? "" : ",", pid, tid, name);
+	*first = 0;
+}
+
+// Prints the events of a dump, returns its size or 0 if there is none at p
+static size_t print_dump(const unsigned char* p, size_t left, int pid, int* first)
+{
+	unsigned count, hz, i;
+	unsigned last = 0;
+	long long now = 0;
+	int tid;
+	if(left < TRACE_HEADER_SIZE || memcmp(p, "NIOT", 4) != 0
+		|| be16(p+4) != 1 || be16(p+6) != TRACE_EVENT_SIZE)
+		return 0;
+	count = be32(p+8);
+	hz = be32(p+12);
+	if(hz == 0 || (left-TRACE_HEADER_SIZE)/TRACE_EVENT_SIZE < count)
+		return 0;
+
+	printf("%s\n{\"ph\":\"M\",\"name\":\"process_name\",\"pid\":%d,\"args\":{\"name\":\"dump %d\"}}", *first ? "" : ",", pid, pid);
+	*first = 0;
+	for(tid = 1; tid < TRACKS; tid++)
+		print_track(first, pid, tid, tracks[tid]);
+
+	for(i = 0; i < count; i++)
+	{
+		const unsigned char* e = p+TRACE_HEADER_SIZE+i*TRACE_EVENT_SIZE;
+		unsigned time = be32(e), duration = be32(e+4);
+		unsigned type = be16(e+8), a = be16(e+10), b = be32(e+12);
+		// The timer wraps around. Events are stored when they end, so each
+		// one ends after the previous one, and the unsigned difference of the
+		// ends tells where it is, up to a wrap. now is the end of this one.
+		if(i == 0)
+			now = duration;
+		else
+			now += time+duration-last;
+		last = time+duration;
+
+		printf(",\n{\"pid\":%d,\"ts\":%.3f,", pid, (double)(now-duration)*1000000/hz);
+		if(duration)
+			printf("\"ph\":\"X\",\"dur\":%.3f,", (double)duration*1000000/hz);
+		else
+			printf("\"ph\":\"i\",\"s\":\"t\",");
+		if(type > 0 && (int)type < TRACE_TYPES)
+		{
+			int track = trace_types[type].track;
+			printf("\"tid\":%d,\"name\":\"%s\",\"cat\":\"%s\",\"args\":{", track, trace_types[type].name, tracks[track]);
+			if(trace_types[type].a != NULL)
+				printf("\"%s\":%u%s", trace_types[type].a, a, trace_types[type].b != NULL ? "," : "");
+			if(trace_types[type].b != NULL)
+				printf("\"%s\":%u", trace_types[type].b, b);
+			printf("}}");
+		}
+		else
+		{
+			if(type >= TRACE_USER)
+				printf("\"tid\":%d,\"name\":\"user %u\",", TRACK_USER, type-TRACE_USER);
+			else
+				printf("\"tid\":%d,\"name\":\"type %u\",", TRACK_USER, type);
+			printf("\"cat\":\"user\",\"args\":{\"a\":%u,\"b\":%u}}", a, b);
+		}
+	}
+	return TRACE_HEADER_SIZE+count*TRACE_EVENT_SIZE;
+}
+
+int main(int argc, char** argv)
+{
+	FILE* f = stdin;
+	unsigned char* buf;
+	size_t size, pos = 0;
+	int dumps = 0, first = 1;
+
+	if(argc > 2)
+	{
+		fprintf(stderr, "usage: %s [dump] > trace.json\n", argv[0]);
+		return 2;
+	}
+	if(argc == 2 && (f = fopen(argv[1], "rb")) == NULL)
+	{
+		perror(argv[1]);
+		return 1;
+	}
+	buf = read_all(f, &size);
+	if(f != stdin)
+		fclose(f);
+	if(buf == NULL)
+	{
+		fprintf(stderr, "out of memory\n");
+		return 1;
+	}
+
+	printf("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+	while(pos < size)
+	{
+		size_t n = print_dump(buf+pos, size-pos, dumps+1, &first);
+		if(n > 0)
+		{
+			dumps++;
+			pos += n;
+		}
+		else
+			pos++;
+	}
+	printf("\n]}\n");
+	free(buf);
+
+	if(dumps == 0)
+	{
+		fprintf(stderr, "no trace dump found\n");
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,194 @@
+/**
+ * @file trace.c
+ * @author  Julien "Juju" Savard <juju2143@gmail.com>
+ * @version 0.1
+ *
+ * @section LICENSE
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301  USA
+ *
+ * @section DESCRIPTION
+ *
+ * Event trace
+ */
+#include <stdlib.h>
+#include <string.h>
+#include "prizmio.h"
+
+/* Events go into a ring that always holds the last NIO_TRACE_SIZE of them,
+ * so recording is a few stores and never blocks. A dump is
+ *   magic "NIOT" (4), version (2), event size (2), events (4), timer rate (4)
+ * followed by the events from the oldest
+ *   time (4), duration (4), type (2), a (2), b (4)
+ * all big-endian, so it reads the same on a computer. tools/trace2json.c
+ * turns it into a Chrome trace.
+ */
+#define TRACE_MAGIC "NIOT"
+#define TRACE_VERSION 1
+#define TRACE_HEADER_SIZE 16
+#define TRACE_EVENT_SIZE 16
+#define TRACE_MASK (NIO_TRACE_SIZE-1)
+
+#if NIO_TRACE_SIZE & TRACE_MASK
+#error NIO_TRACE_SIZE must be a power of 2
+#endif
+
+static nio_trace_event trace_ring[NIO_TRACE_SIZE];
+static unsigned trace_head = 0;
+static BOOL trace_enabled = FALSE;
+
+void nio_trace_enable(const BOOL enable)
+{
+	trace_enabled = enable;
+}
+
+BOOL nio_trace_enabled(void)
+{
+	return trace_enabled;
+}
+
+void nio_trace_clear(void)
+{
+	trace_head = 0;
+}
+
+static inline void nio_trace_put(const int type, const unsigned a, const unsigned b, const unsigned time, const unsigned duration)
+{
+	nio_trace_event* e = &trace_ring[trace_head++ & TRACE_MASK];
+	e->time = time;
+	e->duration = duration;
+	e->type = type;
+	e->a = a;
+	e->b = b;
+}
+
+void nio_trace(const int type, const unsigned a, const unsigned b)
+{
+	if(trace_enabled)
+		nio_trace_put(type, a, b, nio_timer_ticks(), 0);
+}
+
+unsigned nio_trace_begin(void)
+{
+	return trace_enabled ? nio_timer_ticks() : 0;
+}
+
+void nio_trace_end(const int type, const unsigned a, const unsigned b, const unsigned start)
+{
+	if(trace_enabled)
+		nio_trace_put(type, a, b, start, nio_timer_ticks()-start);
+}
+
+int nio_trace_count(void)
+{
+	return trace_head < NIO_TRACE_SIZE ? (int)trace_head : NIO_TRACE_SIZE;
+}
+
+size_t nio_trace_dump_size(void)
+{
+	return TRACE_HEADER_SIZE+nio_trace_count()*TRACE_EVENT_SIZE;
+}
+
+static unsigned char* nio_trace_be16(unsigned char* p, const unsigned n)
+{
+	p[0] = n >> 8;
+	p[1] = n;
+	return p+2;
+}
+
+static unsigned char* nio_trace_be32(unsigned char* p, const unsigned n)
+{
+	p[0] = n >> 24;
+	p[1] = n >> 16;
+	p[2] = n >> 8;
+	p[3] = n;
+	return p+4;
+}
+
+int nio_trace_export(nio_sink sink, void* ctx)
+{
+	unsigned char buf[TRACE_HEADER_SIZE];
+	unsigned char* p = buf;
+	BOOL enabled = trace_enabled;
+	int count = nio_trace_count();
+	unsigned i;
+	// The sink may be traced itself, keep the ring as it is until done
+	trace_enabled = FALSE;
+	memcpy(p, TRACE_MAGIC, 4);
+	p = nio_trace_be16(p+4, TRACE_VERSION);
+	p = nio_trace_be16(p, TRACE_EVENT_SIZE);
+	p = nio_trace_be32(p, count);
+	nio_trace_be32(p, nio_timer_hz());
+	sink(ctx, (const char*)buf, TRACE_HEADER_SIZE);
+	for(i = trace_head-count; i != trace_head; i++)
+	{
+		const nio_trace_event* e = &trace_ring[i & TRACE_MASK];
+		p = nio_trace_be32(buf, e->time);
+		p = nio_trace_be32(p, e->duration);
+		p = nio_trace_be16(p, e->type);
+		p = nio_trace_be16(p, e->a);
+		nio_trace_be32(p, e->b);
+		sink(ctx, (const char*)buf, TRACE_EVENT_SIZE);
+	}
+	trace_enabled = enabled;
+	return TRACE_HEADER_SIZE+count*TRACE_EVENT_SIZE;
+}
+
+static void nio_trace_uart_sink(void* ctx, const char* str, int len)
+{
+	uart_write(str, len);
+}
+
+int nio_trace_send(void)
+{
+	int size = nio_trace_export(nio_trace_uart_sink, NULL);
+	uart_flush();
+	return size;
+}
+
+struct trace_writer
+{
+	reg_writer w;
+	int result;
+};
+
+static void nio_trace_reg_sink(void* ctx, const char* str, int len)
+{
+	struct trace_writer* t = ctx;
+	if(t->result == 0)
+		t->result = reg_writer_write(&t->w, str, len);
+}
+
+int nio_trace_store(reg_db* db, const char* key)
+{
+	struct trace_writer t;
+	BOOL enabled = trace_enabled;
+	if(db == NULL && (db = reg_get_default()) == NULL)
+		return -1;
+	// Registry calls are traced, keep the ring as it is so the size stays right
+	trace_enabled = FALSE;
+	t.result = reg_db_writer_open(db, &t.w, key, nio_trace_dump_size());
+	if(t.result == 0)
+	{
+		nio_trace_export(nio_trace_reg_sink, &t);
+		if(t.result != 0)
+			reg_writer_abort(&t.w);
+		else
+			t.result = reg_writer_close(&t.w);
+	}
+	trace_enabled = enabled;
+	return t.result;
+}
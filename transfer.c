@@ -0,0 +1,411 @@
+/**
+ * @file transfer.c
+ * @author  Julien "Juju" Savard <juju2143@gmail.com>
+ * @author  Julian Mackeben aka compu <compujuckel@googlemail.com>
+ * @version 0.1
+ *
+ * @section LICENSE
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301  USA
+ *
+ * @section DESCRIPTION
+ *
+ * File transfer over the serial port
+ */
+#include <stdlib.h>
+#include <string.h>
+#include "prizmio.h"
+
+/* A transfer is a sequence of frames
+ *   magic (1 byte), type (1), sequence number (1), payload length (2),
+ *   payload, CRC-32 of everything from the type to the payload (4)
+ * with numbers in big-endian order. The sender numbers a START frame
+ * (length of the data (4 bytes) and name), the DATA frames and an END
+ * frame, and keeps up to UART_XFER_WINDOW of them in flight. The
+ * receiver acknowledges every good frame on its own with an ACK frame
+ * carrying its number, keeps the ones that arrive early, and hands the
+ * data on in order. Frames that are not acknowledged in time are sent
+ * again, one by one. A bad frame is dropped and the receiver looks for
+ * the next magic byte after its first one, among the bytes it already
+ * took in as well.
+ */
+#define XFER_MAGIC 0x5A
+#define XFER_START 1
+#define XFER_DATA  2
+#define XFER_END   3
+#define XFER_ACK   4
+#define XFER_ABORT 5
+
+#define XFER_HEADER 5
+#define XFER_TRAILER 4
+
+// Times in ms, measured with nio_time_since() so midnight does not upset them
+#define XFER_TIMEOUT 500    // before a frame is sent again
+#define XFER_RETRIES 16     // times a frame is sent before giving up
+#define XFER_IDLE 10000     // without any frame before the receiver gives up
+#define XFER_LINGER 1000    // spent acknowledging repeated frames after the end
+
+struct xfer_frame
+{
+	unsigned char type;
+	unsigned char seq;
+	unsigned short len;
+	unsigned char payload[UART_XFER_PAYLOAD];
+};
+
+struct xfer_parser
+{
+	int pos;
+	unsigned char buf[XFER_HEADER+UART_XFER_PAYLOAD+XFER_TRAILER];
+};
+
+static void xfer_send(const struct xfer_frame* f)
+{
+	unsigned char head[XFER_HEADER];
+	unsigned char tail[XFER_TRAILER];
+	unsigned int crc;
+	head[0] = XFER_MAGIC;
+	head[1] = f->type;
+	head[2] = f->seq;
+	head[3] = f->len >> 8;
+	head[4] = f->len & 0xFF;
+	crc = nio_crc32(0, head+1, XFER_HEADER-1);
+	crc = nio_crc32(crc, f->payload, f->len);
+	tail[0] = crc >> 24;
+	tail[1] = crc >> 16;
+	tail[2] = crc >> 8;
+	tail[3] = crc;
+	uart_write(head, XFER_HEADER);
+	uart_write(f->payload, f->len);
+	uart_write(tail, XFER_TRAILER);
+}
+
+static void xfer_send_control(int type, int seq)
+{
+	struct xfer_frame f;
+	f.type = type;
+	f.seq = seq;
+	f.len = 0;
+	xfer_send(&f);
+}
+
+// Checks the bytes held by the parser: 1 if they start with a good frame, which is
+// taken out, 0 if more bytes are needed, -1 if they start with a bad frame.
+static int xfer_parse(struct xfer_parser* p, struct xfer_frame* f)
+{
+	int len, size;
+	if(p->pos < XFER_HEADER)
+		return 0;
+	len = p->buf[3] << 8 | p->buf[4];
+	if(len > UART_XFER_PAYLOAD)
+		return -1;
+	size = XFER_HEADER+len+XFER_TRAILER;
+	if(p->pos < size)
+		return 0;
+	if(nio_crc32(0, p->buf+1, XFER_HEADER-1+len) !=
+		((unsigned)p->buf[XFER_HEADER+len] << 24 | p->buf[XFER_HEADER+len+1] << 16 | p->buf[XFER_HEADER+len+2] << 8 | p->buf[XFER_HEADER+len+3]))
+		return -1;
+	f->type = p->buf[1];
+	f->seq = p->buf[2];
+	f->len = len;
+	memcpy(f->payload, p->buf+XFER_HEADER, len);
+	memmove(p->buf, p->buf+size, p->pos-size);
+	p->pos -= size;
+	return 1;
+}
+
+// Takes the received bytes until a good frame is found, returns FALSE if there is none yet.
+static BOOL xfer_receive(struct xfer_parser* p, struct xfer_frame* f)
+{
+	unsigned char c;
+	while(1)
+	{
+		int result = xfer_parse(p, f);
+		if(result > 0)
+			return TRUE;
+		if(result < 0)
+		{
+			// A damaged length may have taken in the start of the next frame:
+			// look for it in what is held, after the magic byte of this one
+			int i;
+			for(i = 1; i < p->pos && p->buf[i] != XFER_MAGIC; i++);
+			memmove(p->buf, p->buf+i, p->pos-i);
+			p->pos -= i;
+			continue;
+		}
+		if(uart_read(&c, 1) != 1)
+			return FALSE;
+		if(p->pos == 0 && c != XFER_MAGIC)
+			continue;
+		p->buf[p->pos++] = c;
+	}
+}
+
+struct xfer_slot
+{
+	struct xfer_frame frame;
+	unsigned sent;
+	int tries;
+	BOOL done;
+};
+
+int uart_send(const char* name, size_t size, nio_source source, void* ctx)
+{
+	struct xfer_slot* slots = malloc(UART_XFER_WINDOW*sizeof(struct xfer_slot));
+	struct xfer_parser parser;
+	struct xfer_frame in;
+	int name_len = strlen(name);
+	// START, the data, END
+	int count = 2+(size+UART_XFER_PAYLOAD-1)/UART_XFER_PAYLOAD;
+	int base = 0, next = 0, i;
+	size_t left = size;
+	if(slots == NULL)
+		return -1;
+	if(name_len > UART_XFER_PAYLOAD-4)
+	{
+		free(slots);
+		return -1;
+	}
+	parser.pos = 0;
+
+	while(base < count)
+	{
+		// Fill the window
+		while(next < count && next < base+UART_XFER_WINDOW)
+		{
+			struct xfer_slot* s = &slots[next%UART_XFER_WINDOW];
+			struct xfer_frame* f = &s->frame;
+			f->seq = next & 0xFF;
+			if(next == 0)
+			{
+				f->type = XFER_START;
+				f->payload[0] = size >> 24;
+				f->payload[1] = size >> 16;
+				f->payload[2] = size >> 8;
+				f->payload[3] = size;
+				memcpy(f->payload+4, name, name_len);
+				f->len = 4+name_len;
+			}
+			else if(next == count-1)
+			{
+				f->type = XFER_END;
+				f->len = 0;
+			}
+			else
+			{
+				int n = left < UART_XFER_PAYLOAD ? left : UART_XFER_PAYLOAD;
+				int got = 0;
+				f->type = XFER_DATA;
+				while(got < n)
+				{
+					int r = source(ctx, (char*)f->payload+got, n-got);
+					if(r <= 0)
+					{
+						xfer_send_control(XFER_ABORT, 0);
+						uart_flush();
+						free(slots);
+						return -1;
+					}
+					got += r;
+				}
+				f->len = n;
+				left -= n;
+			}
+			xfer_send(f);
+			s->sent = nio_time_get();
+			s->tries = 1;
+			s->done = FALSE;
+			next++;
+		}
+
+		// Take the acknowledgements
+		while(xfer_receive(&parser, &in))
+		{
+			int n = base+((in.seq-base) & 0xFF);
+			if(in.type == XFER_ABORT)
+			{
+				free(slots);
+				return -1;
+			}
+			if(in.type == XFER_ACK && n < next)
+				slots[n%UART_XFER_WINDOW].done = TRUE;
+		}
+		while(base < next && slots[base%UART_XFER_WINDOW].done)
+			base++;
+
+		// Send again what is late
+		for(i = base; i < next; i++)
+		{
+			struct xfer_slot* s = &slots[i%UART_XFER_WINDOW];
+			if(s->done || nio_time_since(s->sent) < XFER_TIMEOUT)
+				continue;
+			if(s->tries == XFER_RETRIES)
+			{
+				xfer_send_control(XFER_ABORT, 0);
+				uart_flush();
+				free(slots);
+				return -1;
+			}
+			xfer_send(&s->frame);
+			s->sent = nio_time_get();
+			s->tries++;
+		}
+	}
+	uart_flush();
+	free(slots);
+	return 0;
+}
+
+struct xfer_buffer
+{
+	const char* data;
+	size_t left;
+};
+
+static int xfer_buffer_read(void* ctx, char* buf, int len)
+{
+	struct xfer_buffer* b = ctx;
+	int n = b->left < (size_t)len ? (int)b->left : len;
+	memcpy(buf, b->data, n);
+	b->data += n;
+	b->left -= n;
+	return n;
+}
+
+int uart_send_reg(reg_db* db, const char* key)
+{
+	struct xfer_buffer b;
+	size_t size;
+	int result;
+	if(db == NULL && (db = reg_get_default()) == NULL)
+		return -1;
+	// Mapped data is sent without a copy
+	b.data = reg_db_map(db, key, &size);
+	if(b.data == NULL)
+		return -1;
+	b.left = size;
+	result = uart_send(key, size, xfer_buffer_read, &b);
+	reg_db_unmap(db, b.data);
+	return result;
+}
+
+int uart_receive_reg(reg_db* db, char* key, int key_size)
+{
+	struct xfer_slot* slots = malloc(UART_XFER_WINDOW*sizeof(struct xfer_slot));
+	struct xfer_parser parser;
+	struct xfer_frame in;
+	reg_writer w;
+	BOOL writing = FALSE;
+	int expected = 0;
+	unsigned last = nio_time_get();
+	int i;
+	if(slots == NULL)
+		return -1;
+	if(db == NULL && (db = reg_get_default()) == NULL)
+	{
+		free(slots);
+		return -1;
+	}
+	for(i = 0; i < UART_XFER_WINDOW; i++)
+		slots[i].done = FALSE;
+	parser.pos = 0;
+
+	while(1)
+	{
+		int ahead;
+		if(!xfer_receive(&parser, &in))
+		{
+			if(nio_time_since(last) > XFER_IDLE)
+				break;
+			continue;
+		}
+		last = nio_time_get();
+		if(in.type == XFER_ABORT)
+			break;
+		if(in.type != XFER_START && in.type != XFER_DATA && in.type != XFER_END)
+			continue;
+		ahead = (in.seq-expected) & 0xFF;
+		if(ahead >= 256-UART_XFER_WINDOW)
+		{
+			// Already handed on, the acknowledgement was lost
+			xfer_send_control(XFER_ACK, in.seq);
+			continue;
+		}
+		if(ahead >= UART_XFER_WINDOW)
+			continue;
+		xfer_send_control(XFER_ACK, in.seq);
+		if(!slots[(expected+ahead)%UART_XFER_WINDOW].done)
+		{
+			slots[(expected+ahead)%UART_XFER_WINDOW].frame = in;
+			slots[(expected+ahead)%UART_XFER_WINDOW].done = TRUE;
+		}
+
+		// Hand on the frames that are in order
+		while(slots[expected%UART_XFER_WINDOW].done)
+		{
+			struct xfer_slot* s = &slots[expected%UART_XFER_WINDOW];
+			struct xfer_frame* f = &s->frame;
+			s->done = FALSE;
+			expected++;
+			if(f->type == XFER_START && !writing && f->len >= 4 && f->len-4 < key_size)
+			{
+				size_t size = (size_t)f->payload[0] << 24 | f->payload[1] << 16 | f->payload[2] << 8 | f->payload[3];
+				memcpy(key, f->payload+4, f->len-4);
+				key[f->len-4] = '\0';
+				if(reg_db_writer_open(db, &w, key, size) != 0)
+					goto fail;
+				writing = TRUE;
+			}
+			else if(f->type == XFER_DATA && writing)
+			{
+				if(reg_writer_write(&w, f->payload, f->len) != 0)
+					goto fail;
+			}
+			else if(f->type == XFER_END && writing)
+			{
+				unsigned end = nio_time_get();
+				writing = FALSE;
+				if(reg_writer_close(&w) != 0)
+					goto fail;
+				uart_flush();
+				// The sender may not have the last acknowledgements yet
+				while(nio_time_since(end) < XFER_LINGER)
+				{
+					if(xfer_receive(&parser, &in) && in.type != XFER_ACK)
+					{
+						xfer_send_control(XFER_ACK, in.seq);
+						uart_flush();
+					}
+				}
+				free(slots);
+				return 0;
+			}
+			else
+				goto fail;
+		}
+	}
+	if(writing)
+		reg_writer_abort(&w);
+	free(slots);
+	return -1;
+fail:
+	if(writing)
+		reg_writer_abort(&w);
+	xfer_send_control(XFER_ABORT, 0);
+	uart_flush();
+	free(slots);
+	return -1;
+}
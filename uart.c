@@ -24,24 +24,303 @@
  * @section DESCRIPTION
  *
  * Alternative functions for serial communication, no clock on the screen.
+ *
+ * Bytes go through a transmit and a receive ring. The rings are moved to
+ * and from the backend in blocks, as much as the backend takes per call,
+ * so the OS is not called once per byte. Nothing runs in the background:
+ * the rings are only moved by the uart_* calls, or by uart_poll().
  */
 #include <stdlib.h>
+#include <stdarg.h>
 #include <string.h>
 #include <fxcg/serial.h>
 #include "prizmio.h"
 
+#define UART_MASK (UART_BUFFER_SIZE-1)
+
+#if UART_BUFFER_SIZE & UART_MASK
+#error UART_BUFFER_SIZE must be a power of 2
+#endif
+
+struct uart_ring
+{
+	unsigned head; // next byte written
+	unsigned tail; // next byte read
+	char buf[UART_BUFFER_SIZE];
+};
+
+static struct uart_ring uart_tx, uart_rx;
+
+static inline unsigned uart_ring_used(const struct uart_ring* r)
+{
+	return r->head-r->tail;
+}
+
+// Bytes that can be read from the ring in one block, before it wraps.
+static inline unsigned uart_ring_block(const struct uart_ring* r)
+{
+	unsigned n = uart_ring_used(r);
+	unsigned end = UART_BUFFER_SIZE-(r->tail & UART_MASK);
+	return n < end ? n : end;
+}
+
+// Room that can be written to the ring in one block, before it wraps.
+static inline unsigned uart_ring_room(const struct uart_ring* r)
+{
+	unsigned n = UART_BUFFER_SIZE-uart_ring_used(r);
+	unsigned end = UART_BUFFER_SIZE-(r->head & UART_MASK);
+	return n < end ? n : end;
+}
+
+static const int uart_rates[] = {300, 600, 1200, 2400, 4800, 9600, 19200, 38400, 57600, 115200};
+
+static int serial_open(void* ctx, int baud)
+{
+	unsigned char mode[6] = {0, 9, 0, 0, 0, 0};
+	int i;
+	for(i = 0; i < (int)(sizeof(uart_rates)/sizeof(int)); i++)
+	{
+		if(uart_rates[i] == baud)
+			mode[1] = i;
+	}
+	if(Serial_IsOpen() == 1)
+		return 0;
+	return Serial_Open(mode) == 0 ? 0 : -1;
+}
+
+static void serial_close(void* ctx)
+{
+	Serial_Close(1);
+}
+
+static int serial_write(void* ctx, const char* buf, int len)
+{
+	// The OS queue takes all of a write or nothing, so only send what fits
+	int room = Serial_PollTX();
+	if(room <= 0)
+		return 0;
+	if(len > room)
+		len = room;
+	return Serial_Write((const unsigned char*)buf, len) == 0 ? len : 0;
+}
+
+static int serial_read(void* ctx, char* buf, int len)
+{
+	short count = 0;
+	int available = Serial_PollRX();
+	if(available <= 0)
+		return 0;
+	if(len > available)
+		len = available;
+	if(Serial_Read((unsigned char*)buf, len, &count) != 0)
+		return 0;
+	return count;
+}
+
+const uart_backend uart_serial = {serial_open, serial_close, serial_write, serial_read, NULL};
+
+// The loopback gives back what was written, through a ring of its own.
+static struct uart_ring uart_loop;
+
+static int loopback_open(void* ctx, int baud)
+{
+	uart_loop.head = uart_loop.tail = 0;
+	return 0;
+}
+
+static void loopback_close(void* ctx)
+{
+}
+
+static int loopback_write(void* ctx, const char* buf, int len)
+{
+	int done = 0;
+	while(done < len)
+	{
+		int n = uart_ring_room(&uart_loop);
+		if(n == 0)
+			break;
+		if(n > len-done)
+			n = len-done;
+		memcpy(uart_loop.buf+(uart_loop.head & UART_MASK), buf+done, n);
+		uart_loop.head += n;
+		done += n;
+	}
+	return done;
+}
+
+static int loopback_read(void* ctx, char* buf, int len)
+{
+	int done = 0;
+	while(done < len)
+	{
+		int n = uart_ring_block(&uart_loop);
+		if(n == 0)
+			break;
+		if(n > len-done)
+			n = len-done;
+		memcpy(buf+done, uart_loop.buf+(uart_loop.tail & UART_MASK), n);
+		uart_loop.tail += n;
+		done += n;
+	}
+	return done;
+}
+
+const uart_backend uart_loopback = {loopback_open, loopback_close, loopback_write, loopback_read, NULL};
+
+static const uart_backend* uart_backend_current = &uart_serial;
+
+void uart_backend_set(const uart_backend* backend)
+{
+	uart_backend_current = backend != NULL ? backend : &uart_serial;
+	uart_tx.head = uart_tx.tail = 0;
+	uart_rx.head = uart_rx.tail = 0;
+}
+
+int uart_open(int baud)
+{
+	uart_tx.head = uart_tx.tail = 0;
+	uart_rx.head = uart_rx.tail = 0;
+	return uart_backend_current->open(uart_backend_current->ctx, baud);
+}
+
+void uart_close(void)
+{
+	uart_flush();
+	uart_backend_current->close(uart_backend_current->ctx);
+}
+
+// Moves as much as possible from the transmit ring to the backend, returns how much.
+static unsigned uart_pump_tx(void)
+{
+	const uart_backend* b = uart_backend_current;
+	unsigned n, total = 0;
+	while((n = uart_ring_block(&uart_tx)) > 0)
+	{
+		int sent = b->write(b->ctx, uart_tx.buf+(uart_tx.tail & UART_MASK), n);
+		if(sent <= 0)
+			break;
+		uart_tx.tail += sent;
+		total += sent;
+	}
+	if(total)
+		nio_trace(NIO_TRACE_UART_TX, 0, total);
+	return total;
+}
+
+// Moves as much as possible from the backend to the receive ring.
+static void uart_pump_rx(void)
+{
+	const uart_backend* b = uart_backend_current;
+	unsigned n, total = 0;
+	while((n = uart_ring_room(&uart_rx)) > 0)
+	{
+		int got = b->read(b->ctx, uart_rx.buf+(uart_rx.head & UART_MASK), n);
+		if(got <= 0)
+			break;
+		uart_rx.head += got;
+		total += got;
+	}
+	if(total)
+		nio_trace(NIO_TRACE_UART_RX, 0, total);
+}
+
+void uart_poll(void)
+{
+	uart_pump_tx();
+	uart_pump_rx();
+}
+
+// Waits until the backend takes some of the transmit ring. FALSE if it
+// takes nothing for UART_TIMEOUT ms, as when the port is not open.
+static BOOL uart_wait_tx(void)
+{
+	unsigned start = nio_time_get();
+	while(uart_pump_tx() == 0)
+	{
+		if(nio_time_since(start) >= UART_TIMEOUT)
+			return FALSE;
+	}
+	return TRUE;
+}
+
+void uart_flush(void)
+{
+	while(uart_ring_used(&uart_tx) > 0 && uart_wait_tx());
+}
+
+int uart_write(const void* buf, int len)
+{
+	const char* p = buf;
+	int done = 0;
+	// With nothing queued, large blocks go straight to the backend
+	if(uart_ring_used(&uart_tx) == 0 && len >= UART_BUFFER_SIZE)
+	{
+		const uart_backend* b = uart_backend_current;
+		int sent = b->write(b->ctx, p, len);
+		if(sent > 0)
+		{
+			done = sent;
+			nio_trace(NIO_TRACE_UART_TX, 0, sent);
+		}
+	}
+	while(done < len)
+	{
+		int n = uart_ring_room(&uart_tx);
+		if(n == 0)
+		{
+			// Full, wait for the backend to take some
+			if(!uart_wait_tx())
+				break;
+			continue;
+		}
+		if(n > len-done)
+			n = len-done;
+		memcpy(uart_tx.buf+(uart_tx.head & UART_MASK), p+done, n);
+		uart_tx.head += n;
+		done += n;
+	}
+	uart_pump_tx();
+	return done;
+}
+
+int uart_read(void* buf, int len)
+{
+	char* p = buf;
+	int done = 0;
+	uart_pump_rx();
+	while(done < len)
+	{
+		int n = uart_ring_block(&uart_rx);
+		if(n == 0)
+			break;
+		if(n > len-done)
+			n = len-done;
+		memcpy(p+done, uart_rx.buf+(uart_rx.tail & UART_MASK), n);
+		uart_rx.tail += n;
+		done += n;
+		// Refill in case the backend had more than the ring could hold
+		if(uart_ring_used(&uart_rx) == 0)
+			uart_pump_rx();
+	}
+	return done;
+}
+
 BOOL uart_ready(void)
 {
-	return (Serial_IsOpen()==1) ? TRUE : FALSE;
+	if(uart_ring_used(&uart_rx) == 0)
+		uart_pump_rx();
+	return uart_ring_used(&uart_rx) > 0 ? TRUE : FALSE;
 }
 
 char uart_getchar(void)
 {
-/*	volatile unsigned *line_status_reg = is_classic ? (unsigned*)0x90020014 : (unsigned*)0x90020018;
-	volatile unsigned *recv_buffer_reg = (unsigned*)0x90020000;
-	while(!(*line_status_reg & 0b1));
-	return *recv_buffer_reg;
-*/	return '\n';
+	char c;
+	// Sending is not held up while waiting for input
+	uart_pump_tx();
+	while(uart_read(&c, 1) != 1)
+		uart_pump_tx();
+	return c;
 }
 
 char* uart_gets(char* str)
@@ -61,28 +340,30 @@ char* uart_gets(char* str)
 
 char uart_putchar(char c)
 {
-/*	volatile unsigned *line_status_reg = is_classic ? (unsigned*)0x90020014 : (unsigned*)0x90020018;
-	volatile unsigned *xmit_holding_reg = (unsigned*)0x90020000;
-	while(!(*line_status_reg & 0b100000)); // wait for empty xmit holding reg
-		*xmit_holding_reg = c;*/
-    return 0;
+	// Single bytes are only queued, and sent at the end of a line or when the ring is full
+	if(uart_ring_room(&uart_tx) == 0 && !uart_wait_tx())
+		return c;
+	uart_tx.buf[uart_tx.head++ & UART_MASK] = c;
+	if(c == '\n')
+		uart_pump_tx();
+	return c;
 }
 
 int uart_puts(const char *str)
 {
-	while(*str) {
-		uart_putchar(*str++);
-	}
-    return 1;
+	uart_write(str, strlen(str));
+	return 1;
+}
+
+static void uart_sink(void* ctx, const char* str, int len)
+{
+	uart_write(str, len);
 }
 
 void uart_printf(char *format, ...)
 {
-	char buf[256];
-	memset(buf,'\0',256);
-	__builtin_va_list arglist;
-	__builtin_va_start(arglist,format);
-	vsprintf(buf,format,*(char **)&arglist);
-	uart_puts(buf);
-	__builtin_va_end(arglist);
+	va_list arglist;
+	va_start(arglist,format);
+	nio_vxprintf(uart_sink,NULL,format,arglist);
+	va_end(arglist);
 }